@@ -12,22 +12,25 @@
 
 #include <string.h>
 
-#if defined(X25519_ASM) && (defined(__x86_64) || defined(__x86_64__) || \
-                            defined(_M_AMD64) || defined(_M_X64))
+#if (defined(X25519_ASM) || (defined(__GNUC__) && !defined(GE_NO_FE64))) \
+    && (defined(__x86_64) || defined(__x86_64__) || \
+        defined(_M_AMD64) || defined(_M_X64))
 
 # define BASE_2_64_IMPLEMENTED
 
 typedef uint64_t fe64[4];
 
-int x25519_fe64_eligible(void);
-
 /*
  * Following subroutines perform corresponding operations modulo
  * 2^256-38, i.e. double the curve modulus. However, inputs and
  * outputs are permitted to be partially reduced, i.e. to remain
  * in [0..2^256) range. It's all tied up in final fe64_tobytes
  * that performs full reduction modulo 2^255-19.
- *
+ */
+# if defined(X25519_ASM)
+int x25519_fe64_eligible(void);
+
+/*
  * There are no reference C implementations for these.
  */
 void x25519_fe64_mul(fe64 h, const fe64 f, const fe64 g);
@@ -36,6 +39,285 @@ void x25519_fe64_mul121666(fe64 h, fe64 f);
 void x25519_fe64_add(fe64 h, const fe64 f, const fe64 g);
 void x25519_fe64_sub(fe64 h, const fe64 f, const fe64 g);
 void x25519_fe64_tobytes(uint8_t *s, const fe64 f);
+# else
+#  include <cpuid.h>
+#  include <x86intrin.h>
+
+/*
+ * Inline assembly versions of the subroutines above, for builds without
+ * the perlasm modules. Multiplication and squaring use MULX (BMI2) with
+ * the two independent carry chains of ADCX/ADOX (ADX). They are written
+ * as asm rather than intrinsics so that they need no -mbmi2 -madx and
+ * the same binary runs everywhere: callers must check
+ * x25519_fe64_eligible() first (see GE_BASE_2_64 below).
+ */
+static inline int x25519_fe64_eligible(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0, NULL) < 7)
+        return 0;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    /* BMI2 is bit 8 and ADX bit 19 of EBX */
+    return (ebx & (1u << 8)) != 0 && (ebx & (1u << 19)) != 0;
+}
+
+/* One row of a schoolbook product: t[i..i+4] += f * g_i, rdx = g_i */
+#  define FE64_MUL_ROW(a, b, c, d, e)          \
+    "xorl %k[" e "], %k[" e "]\n\t"            \
+    "mulxq 0(%[f]), %[lo], %[hi]\n\t"            \
+    "adcxq %[lo], %[" a "]\n\t"                \
+    "adoxq %[hi], %[" b "]\n\t"                \
+    "mulxq 8(%[f]), %[lo], %[hi]\n\t"            \
+    "adcxq %[lo], %[" b "]\n\t"                \
+    "adoxq %[hi], %[" c "]\n\t"                \
+    "mulxq 16(%[f]), %[lo], %[hi]\n\t"            \
+    "adcxq %[lo], %[" c "]\n\t"                \
+    "adoxq %[hi], %[" d "]\n\t"                \
+    "mulxq 24(%[f]), %[lo], %[hi]\n\t"            \
+    "adcxq %[lo], %[" d "]\n\t"                \
+    "movl $0, %k[lo]\n\t"                      \
+    "adoxq %[hi], %[" e "]\n\t"                \
+    "adcxq %[lo], %[" e "]\n\t"
+
+/*
+ * h = t0..t3 + 38 * t4..t7 mod 2^256-38, as 2^256 = 38. The top limb of
+ * that sum is folded once more, and the carry of the fold a last time.
+ */
+#  define FE64_REDUCE                          \
+    "movl $38, %%edx\n\t"                      \
+    "xorl %k[lo], %k[lo]\n\t"                  \
+    "mulxq %[t4], %[lo], %[hi]\n\t"            \
+    "adcxq %[lo], %[t0]\n\t"                   \
+    "adoxq %[hi], %[t1]\n\t"                   \
+    "mulxq %[t5], %[lo], %[hi]\n\t"            \
+    "adcxq %[lo], %[t1]\n\t"                   \
+    "adoxq %[hi], %[t2]\n\t"                   \
+    "mulxq %[t6], %[lo], %[hi]\n\t"            \
+    "adcxq %[lo], %[t2]\n\t"                   \
+    "adoxq %[hi], %[t3]\n\t"                   \
+    "mulxq %[t7], %[lo], %[t4]\n\t"            \
+    "adcxq %[lo], %[t3]\n\t"                   \
+    "movl $0, %k[lo]\n\t"                      \
+    "adoxq %[lo], %[t4]\n\t"                   \
+    "adcxq %[lo], %[t4]\n\t"                   \
+    "imulq $38, %[t4], %[t4]\n\t"              \
+    "addq %[t4], %[t0]\n\t"                    \
+    "adcq $0, %[t1]\n\t"                       \
+    "adcq $0, %[t2]\n\t"                       \
+    "adcq $0, %[t3]\n\t"                       \
+    "sbbq %[lo], %[lo]\n\t"                    \
+    "andq $38, %[lo]\n\t"                      \
+    "addq %[lo], %[t0]\n\t"
+
+static void x25519_fe64_mul(fe64 h, const fe64 f, const fe64 g)
+{
+    uint64_t t0, t1, t2, t3, t4, t5, t6, t7, lo, hi;
+
+    __asm__ (
+        /* t0..t4 = f * g[0] */
+        "movq 0(%[g]), %%rdx\n\t"
+        "mulxq 0(%[f]), %[t0], %[t1]\n\t"
+        "mulxq 8(%[f]), %[lo], %[t2]\n\t"
+        "addq %[lo], %[t1]\n\t"
+        "mulxq 16(%[f]), %[lo], %[t3]\n\t"
+        "adcq %[lo], %[t2]\n\t"
+        "mulxq 24(%[f]), %[lo], %[t4]\n\t"
+        "adcq %[lo], %[t3]\n\t"
+        "adcq $0, %[t4]\n\t"
+        "movq 8(%[g]), %%rdx\n\t"
+        FE64_MUL_ROW("t1", "t2", "t3", "t4", "t5")
+        "movq 16(%[g]), %%rdx\n\t"
+        FE64_MUL_ROW("t2", "t3", "t4", "t5", "t6")
+        "movq 24(%[g]), %%rdx\n\t"
+        FE64_MUL_ROW("t3", "t4", "t5", "t6", "t7")
+        FE64_REDUCE
+        : [t0] "=&r" (t0), [t1] "=&r" (t1), [t2] "=&r" (t2), [t3] "=&r" (t3),
+          [t4] "=&r" (t4), [t5] "=&r" (t5), [t6] "=&r" (t6), [t7] "=&r" (t7),
+          [lo] "=&r" (lo), [hi] "=&r" (hi)
+        : [f] "r" (f), [g] "r" (g)
+        : "rdx", "cc", "memory");
+
+    h[0] = t0;
+    h[1] = t1;
+    h[2] = t2;
+    h[3] = t3;
+}
+
+static void x25519_fe64_sqr(fe64 h, const fe64 f)
+{
+    uint64_t t0, t1, t2, t3, t4, t5, t6, t7, lo, hi;
+
+    __asm__ (
+        /* t1..t6 = sum of f[i] * f[j] * 2^(64(i+j)) over i < j */
+        "movq 0(%[f]), %%rdx\n\t"
+        "mulxq 8(%[f]), %[t1], %[t2]\n\t"
+        "mulxq 16(%[f]), %[lo], %[t3]\n\t"
+        "addq %[lo], %[t2]\n\t"
+        "mulxq 24(%[f]), %[lo], %[t4]\n\t"
+        "adcq %[lo], %[t3]\n\t"
+        "adcq $0, %[t4]\n\t"
+        "movq 8(%[f]), %%rdx\n\t"
+        "xorl %k[t5], %k[t5]\n\t"
+        "mulxq 16(%[f]), %[lo], %[hi]\n\t"
+        "adcxq %[lo], %[t3]\n\t"
+        "adoxq %[hi], %[t4]\n\t"
+        "mulxq 24(%[f]), %[lo], %[hi]\n\t"
+        "adcxq %[lo], %[t4]\n\t"
+        "movl $0, %k[lo]\n\t"
+        "adoxq %[hi], %[t5]\n\t"
+        "adcxq %[lo], %[t5]\n\t"
+        "movq 16(%[f]), %%rdx\n\t"
+        "mulxq 24(%[f]), %[lo], %[t6]\n\t"
+        "addq %[lo], %[t5]\n\t"
+        "adcq $0, %[t6]\n\t"
+
+        /* double them, then add the squares f[i]^2 * 2^(128i) */
+        "xorl %k[t7], %k[t7]\n\t"
+        "addq %[t1], %[t1]\n\t"
+        "adcq %[t2], %[t2]\n\t"
+        "adcq %[t3], %[t3]\n\t"
+        "adcq %[t4], %[t4]\n\t"
+        "adcq %[t5], %[t5]\n\t"
+        "adcq %[t6], %[t6]\n\t"
+        "adcq %[t7], %[t7]\n\t"
+        "movq 0(%[f]), %%rdx\n\t"
+        "mulxq %%rdx, %[t0], %[hi]\n\t"
+        "addq %[hi], %[t1]\n\t"
+        "movq 8(%[f]), %%rdx\n\t"
+        "mulxq %%rdx, %[lo], %[hi]\n\t"
+        "adcq %[lo], %[t2]\n\t"
+        "adcq %[hi], %[t3]\n\t"
+        "movq 16(%[f]), %%rdx\n\t"
+        "mulxq %%rdx, %[lo], %[hi]\n\t"
+        "adcq %[lo], %[t4]\n\t"
+        "adcq %[hi], %[t5]\n\t"
+        "movq 24(%[f]), %%rdx\n\t"
+        "mulxq %%rdx, %[lo], %[hi]\n\t"
+        "adcq %[lo], %[t6]\n\t"
+        "adcq %[hi], %[t7]\n\t"
+        FE64_REDUCE
+        : [t0] "=&r" (t0), [t1] "=&r" (t1), [t2] "=&r" (t2), [t3] "=&r" (t3),
+          [t4] "=&r" (t4), [t5] "=&r" (t5), [t6] "=&r" (t6), [t7] "=&r" (t7),
+          [lo] "=&r" (lo), [hi] "=&r" (hi)
+        : [f] "r" (f)
+        : "rdx", "cc", "memory");
+
+    h[0] = t0;
+    h[1] = t1;
+    h[2] = t2;
+    h[3] = t3;
+}
+
+#  undef FE64_MUL_ROW
+#  undef FE64_REDUCE
+
+static void x25519_fe64_add(fe64 h, const fe64 f, const fe64 g)
+{
+    unsigned long long t0, t1, t2, t3;
+    unsigned char c;
+
+    c = _addcarry_u64(0, f[0], g[0], &t0);
+    c = _addcarry_u64(c, f[1], g[1], &t1);
+    c = _addcarry_u64(c, f[2], g[2], &t2);
+    c = _addcarry_u64(c, f[3], g[3], &t3);
+    /* 2^256 = 38; a second carry leaves t0 small enough for the last fold */
+    c = _addcarry_u64(0, t0, (0 - (uint64_t)c) & 38, &t0);
+    c = _addcarry_u64(c, t1, 0, &t1);
+    c = _addcarry_u64(c, t2, 0, &t2);
+    c = _addcarry_u64(c, t3, 0, &t3);
+
+    h[0] = t0 + ((0 - (uint64_t)c) & 38);
+    h[1] = t1;
+    h[2] = t2;
+    h[3] = t3;
+}
+
+static void x25519_fe64_sub(fe64 h, const fe64 f, const fe64 g)
+{
+    unsigned long long t0, t1, t2, t3;
+    unsigned char b;
+
+    b = _subborrow_u64(0, f[0], g[0], &t0);
+    b = _subborrow_u64(b, f[1], g[1], &t1);
+    b = _subborrow_u64(b, f[2], g[2], &t2);
+    b = _subborrow_u64(b, f[3], g[3], &t3);
+    b = _subborrow_u64(0, t0, (0 - (uint64_t)b) & 38, &t0);
+    b = _subborrow_u64(b, t1, 0, &t1);
+    b = _subborrow_u64(b, t2, 0, &t2);
+    b = _subborrow_u64(b, t3, 0, &t3);
+
+    h[0] = t0 - ((0 - (uint64_t)b) & 38);
+    h[1] = t1;
+    h[2] = t2;
+    h[3] = t3;
+}
+
+static inline void x25519_fe64_mul121666(fe64 h, fe64 f)
+{
+    unsigned __int128 p0, p1, p2, p3;
+    unsigned long long t0, t1, t2, t3;
+    unsigned char c;
+
+    p0 = (unsigned __int128)f[0] * 121666;
+    p1 = (unsigned __int128)f[1] * 121666 + (uint64_t)(p0 >> 64);
+    p2 = (unsigned __int128)f[2] * 121666 + (uint64_t)(p1 >> 64);
+    p3 = (unsigned __int128)f[3] * 121666 + (uint64_t)(p2 >> 64);
+    c = _addcarry_u64(0, (uint64_t)p0, (uint64_t)(p3 >> 64) * 38, &t0);
+    c = _addcarry_u64(c, (uint64_t)p1, 0, &t1);
+    c = _addcarry_u64(c, (uint64_t)p2, 0, &t2);
+    c = _addcarry_u64(c, (uint64_t)p3, 0, &t3);
+
+    h[0] = t0 + ((0 - (uint64_t)c) & 38);
+    h[1] = t1;
+    h[2] = t2;
+    h[3] = t3;
+}
+
+/* Fully reduced modulo 2^255-19 */
+static void x25519_fe64_tobytes(uint8_t *s, const fe64 f)
+{
+    unsigned long long t0, t1, t2, t3, u0, u1, u2, u3;
+    uint64_t top, mask;
+    unsigned char c;
+    int i;
+
+    t0 = f[0];
+    t1 = f[1];
+    t2 = f[2];
+    t3 = f[3];
+
+    /* 2^255 = 19, twice brings f below 2^255 */
+    for (i = 0; i < 2; i++) {
+        top = t3 >> 63;
+        t3 &= 0x7fffffffffffffff;
+        c = _addcarry_u64(0, t0, top * 19, &t0);
+        c = _addcarry_u64(c, t1, 0, &t1);
+        c = _addcarry_u64(c, t2, 0, &t2);
+        _addcarry_u64(c, t3, 0, &t3);
+    }
+
+    /* f >= p iff f + 19 >= 2^255, and then f - p = f + 19 - 2^255 */
+    c = _addcarry_u64(0, t0, 19, &u0);
+    c = _addcarry_u64(c, t1, 0, &u1);
+    c = _addcarry_u64(c, t2, 0, &u2);
+    _addcarry_u64(c, t3, 0, &u3);
+    mask = 0 - (u3 >> 63);
+    u3 &= 0x7fffffffffffffff;
+    t0 ^= (t0 ^ u0) & mask;
+    t1 ^= (t1 ^ u1) & mask;
+    t2 ^= (t2 ^ u2) & mask;
+    t3 ^= (t3 ^ u3) & mask;
+
+    for (i = 0; i < 8; i++) {
+        s[i] = (uint8_t)(t0 >> (8 * i));
+        s[8 + i] = (uint8_t)(t1 >> (8 * i));
+        s[16 + i] = (uint8_t)(t2 >> (8 * i));
+        s[24 + i] = (uint8_t)(t3 >> (8 * i));
+    }
+}
+# endif
+
 # define fe64_mul x25519_fe64_mul
 # define fe64_sqr x25519_fe64_sqr
 # define fe64_mul121666 x25519_fe64_mul121666
@@ -59,7 +341,7 @@ static uint64_t load_8(const uint8_t *in)
     return result;
 }
 
-static void fe64_frombytes(fe64 h, const uint8_t *s)
+static inline void fe64_frombytes(fe64 h, const uint8_t *s)
 {
     h[0] = load_8(s);
     h[1] = load_8(s + 8);
@@ -67,7 +349,7 @@ static void fe64_frombytes(fe64 h, const uint8_t *s)
     h[3] = load_8(s + 24) & 0x7fffffffffffffff;
 }
 
-static void fe64_0(fe64 h)
+static inline void fe64_0(fe64 h)
 {
     h[0] = 0;
     h[1] = 0;
@@ -75,7 +357,7 @@ static void fe64_0(fe64 h)
     h[3] = 0;
 }
 
-static void fe64_1(fe64 h)
+static inline void fe64_1(fe64 h)
 {
     h[0] = 1;
     h[1] = 0;
@@ -83,7 +365,7 @@ static void fe64_1(fe64 h)
     h[3] = 0;
 }
 
-static void fe64_copy(fe64 h, const fe64 f)
+static inline void fe64_copy(fe64 h, const fe64 f)
 {
     h[0] = f[0];
     h[1] = f[1];
@@ -91,7 +373,7 @@ static void fe64_copy(fe64 h, const fe64 f)
     h[3] = f[3];
 }
 
-static void fe64_cswap(fe64 f, fe64 g, unsigned int b)
+static inline void fe64_cswap(fe64 f, fe64 g, unsigned int b)
 {
     int i;
     uint64_t mask = 0 - (uint64_t)b;
@@ -104,7 +386,41 @@ static void fe64_cswap(fe64 f, fe64 g, unsigned int b)
     }
 }
 
-static void fe64_invert(fe64 out, const fe64 z)
+/* h = -f */
+static inline void fe64_neg(fe64 h, const fe64 f)
+{
+    static const fe64 zero = {0, 0, 0, 0};
+
+    fe64_sub(h, zero, f);
+}
+
+/* h = 2 * f * f */
+static inline void fe64_sq2(fe64 h, const fe64 f)
+{
+    fe64_sqr(h, f);
+    fe64_add(h, h, h);
+}
+
+/* Replace (f,g) with (g,g) if b == 1; replace (f,g) with (f,g) if b == 0. */
+static inline void fe64_cmov(fe64 f, const fe64 g, unsigned b)
+{
+    uint64_t mask = 0 - (uint64_t)b;
+
+    f[0] ^= (f[0] ^ g[0]) & mask;
+    f[1] ^= (f[1] ^ g[1]) & mask;
+    f[2] ^= (f[2] ^ g[2]) & mask;
+    f[3] ^= (f[3] ^ g[3]) & mask;
+}
+
+static inline int fe64_isnegative(const fe64 f)
+{
+    uint8_t s[32];
+
+    fe64_tobytes(s, f);
+    return s[0] & 1;
+}
+
+static inline void fe64_invert(fe64 out, const fe64 z)
 {
     fe64 t0;
     fe64 t1;
@@ -195,6 +511,7 @@ static void fe64_invert(fe64 out, const fe64 z)
     fe64_mul(out, t1, t0);
 }
 
+# if defined(X25519_ASM)
 /*
  * Duplicate of original x25519_scalar_mult_generic, but using
  * fe64_* subroutines.
@@ -250,6 +567,7 @@ static void x25519_scalar_mulx(uint8_t out[32], const uint8_t scalar[32],
 
     OPENSSL_cleanse(e, sizeof(e));
 }
+# endif
 #endif
 
 #if defined(X25519_ASM) \
@@ -281,8 +599,310 @@ void x25519_fe51_mul121666(fe51 h, fe51 f);
 
 typedef __uint128_t u128;
 
+/*
+ * h = (h0, ..., h4) mod p, for 128-bit column sums of a product.
+ *
+ * Postconditions:
+ *    h[0], h[2], h[3], h[4] < 2^51, h[1] < 2^51 + 2^8.
+ */
+static void fe51_reduce(fe51 h, u128 h0, u128 h1, u128 h2, u128 h3, u128 h4)
+{
+    uint64_t r0, r1, r2, r3, r4;
+
+    r0 = (uint64_t)h0 & MASK51; h1 += (uint64_t)(h0 >> 51);
+    r1 = (uint64_t)h1 & MASK51; h2 += (uint64_t)(h1 >> 51);
+    r2 = (uint64_t)h2 & MASK51; h3 += (uint64_t)(h2 >> 51);
+    r3 = (uint64_t)h3 & MASK51; h4 += (uint64_t)(h3 >> 51);
+    r4 = (uint64_t)h4 & MASK51;
+    r0 += (uint64_t)(h4 >> 51) * 19;
+    r1 += r0 >> 51; r0 &= MASK51;
+
+    h[0] = r0;
+    h[1] = r1;
+    h[2] = r2;
+    h[3] = r3;
+    h[4] = r4;
+}
+
+/*
+ * h = f * g
+ *
+ * Can overlap h with f or g.
+ *
+ * Preconditions:
+ *    |f|, |g| limbs bounded by 2^51 + 2^8.
+ *
+ * Postconditions:
+ *    |h| limbs bounded by 2^51 + 2^8.
+ */
+static void fe51_mul(fe51 h, const fe51 f, const fe51 g)
+{
+    uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+    uint64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+    uint64_t g1_19 = 19 * g1;
+    uint64_t g2_19 = 19 * g2;
+    uint64_t g3_19 = 19 * g3;
+    uint64_t g4_19 = 19 * g4;
+    u128 h0, h1, h2, h3, h4;
+
+    h0 = (u128)f0 * g0 + (u128)f1 * g4_19 + (u128)f2 * g3_19
+       + (u128)f3 * g2_19 + (u128)f4 * g1_19;
+    h1 = (u128)f0 * g1 + (u128)f1 * g0 + (u128)f2 * g4_19
+       + (u128)f3 * g3_19 + (u128)f4 * g2_19;
+    h2 = (u128)f0 * g2 + (u128)f1 * g1 + (u128)f2 * g0
+       + (u128)f3 * g4_19 + (u128)f4 * g3_19;
+    h3 = (u128)f0 * g3 + (u128)f1 * g2 + (u128)f2 * g1
+       + (u128)f3 * g0 + (u128)f4 * g4_19;
+    h4 = (u128)f0 * g4 + (u128)f1 * g3 + (u128)f2 * g2
+       + (u128)f3 * g1 + (u128)f4 * g0;
+
+    fe51_reduce(h, h0, h1, h2, h3, h4);
+}
+
+/*
+ * h = f * f
+ *
+ * Can overlap h with f. Same bounds as fe51_mul.
+ */
+static void fe51_sq(fe51 h, const fe51 f)
+{
+    uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+    uint64_t f0_2 = 2 * f0;
+    uint64_t f1_2 = 2 * f1;
+    uint64_t f2_2 = 2 * f2;
+    uint64_t f3_2 = 2 * f3;
+    uint64_t f3_19 = 19 * f3;
+    uint64_t f4_19 = 19 * f4;
+    u128 h0, h1, h2, h3, h4;
+
+    h0 = (u128)f0 * f0 + (u128)f1_2 * f4_19 + (u128)f2_2 * f3_19;
+    h1 = (u128)f0_2 * f1 + (u128)f2_2 * f4_19 + (u128)f3 * f3_19;
+    h2 = (u128)f0_2 * f2 + (u128)f1 * f1 + (u128)f3_2 * f4_19;
+    h3 = (u128)f0_2 * f3 + (u128)f1_2 * f2 + (u128)f4 * f4_19;
+    h4 = (u128)f0_2 * f4 + (u128)f1_2 * f3 + (u128)f2 * f2;
+
+    fe51_reduce(h, h0, h1, h2, h3, h4);
+}
+
 # endif
 
+/*
+ * The rest of the base 2^51 field arithmetic, so that the group operations
+ * can run on it (see gfe below). Every function keeps limbs bounded by
+ * 2^51 + 2^8, which the multiplications above accept.
+ */
+
+/* Propagate carries so that every limb is below 2^51 (limb 0 below 2^51 + 2^8) */
+static void fe51_carry(fe51 h)
+{
+    h[1] += h[0] >> 51; h[0] &= MASK51;
+    h[2] += h[1] >> 51; h[1] &= MASK51;
+    h[3] += h[2] >> 51; h[2] &= MASK51;
+    h[4] += h[3] >> 51; h[3] &= MASK51;
+    h[0] += (h[4] >> 51) * 19; h[4] &= MASK51;
+}
+
+/* h = f */
+static void fe51_copy(fe51 h, const fe51 f)
+{
+    memmove(h, f, sizeof(uint64_t) * 5);
+}
+
+/* h = 0 */
+static void fe51_0(fe51 h)
+{
+    memset(h, 0, sizeof(uint64_t) * 5);
+}
+
+/* h = 1 */
+static inline void fe51_1(fe51 h)
+{
+    memset(h, 0, sizeof(uint64_t) * 5);
+    h[0] = 1;
+}
+
+/* h = f + g. Can overlap h with f or g. */
+static void fe51_add(fe51 h, const fe51 f, const fe51 g)
+{
+    h[0] = f[0] + g[0];
+    h[1] = f[1] + g[1];
+    h[2] = f[2] + g[2];
+    h[3] = f[3] + g[3];
+    h[4] = f[4] + g[4];
+    fe51_carry(h);
+}
+
+/* h = f - g, computed as f + 2p - g. Can overlap h with f or g. */
+static void fe51_sub(fe51 h, const fe51 f, const fe51 g)
+{
+    h[0] = (f[0] + 0xfffffffffffdaULL) - g[0];
+    h[1] = (f[1] + 0xffffffffffffeULL) - g[1];
+    h[2] = (f[2] + 0xffffffffffffeULL) - g[2];
+    h[3] = (f[3] + 0xffffffffffffeULL) - g[3];
+    h[4] = (f[4] + 0xffffffffffffeULL) - g[4];
+    fe51_carry(h);
+}
+
+/* h = -f */
+static inline void fe51_neg(fe51 h, const fe51 f)
+{
+    fe51 zero;
+
+    fe51_0(zero);
+    fe51_sub(h, zero, f);
+}
+
+/* h = 2 * f * f */
+static inline void fe51_sq2(fe51 h, const fe51 f)
+{
+    fe51_sq(h, f);
+    fe51_add(h, h, h);
+}
+
+/*
+ * Replace (f,g) with (g,g) if b == 1;
+ * replace (f,g) with (f,g) if b == 0.
+ *
+ * Preconditions: b in {0,1}.
+ */
+static inline void fe51_cmov(fe51 f, const fe51 g, unsigned b)
+{
+    uint64_t mask = 0 - (uint64_t)b;
+    size_t i;
+
+    for (i = 0; i < 5; i++) {
+        f[i] ^= mask & (f[i] ^ g[i]);
+    }
+}
+
+/* Ignores the top bit of s[31], like fe_frombytes in ref10 */
+static inline void fe51_frombytes(fe51 h, const uint8_t *s)
+{
+    uint64_t w[4];
+    int i, j;
+
+    for (i = 0; i < 4; i++) {
+        w[i] = 0;
+        for (j = 7; j >= 0; j--) {
+            w[i] = (w[i] << 8) | s[8 * i + j];
+        }
+    }
+
+    h[0] = w[0] & MASK51;
+    h[1] = ((w[0] >> 51) | (w[1] << 13)) & MASK51;
+    h[2] = ((w[1] >> 38) | (w[2] << 26)) & MASK51;
+    h[3] = ((w[2] >> 25) | (w[3] << 39)) & MASK51;
+    h[4] = (w[3] >> 12) & MASK51;
+}
+
+/* Canonical little-endian encoding of f mod p */
+static void fe51_tobytes(uint8_t *s, const fe51 f)
+{
+    fe51 h;
+    uint64_t q;
+    uint64_t w[4];
+    int i, j;
+
+    fe51_copy(h, f);
+    fe51_carry(h);
+    fe51_carry(h);
+
+    /* h < 2p here, so h >= p exactly when h + 19 >= 2^255 */
+    q = (h[0] + 19) >> 51;
+    q = (h[1] + q) >> 51;
+    q = (h[2] + q) >> 51;
+    q = (h[3] + q) >> 51;
+    q = (h[4] + q) >> 51;
+
+    h[0] += 19 * q;
+    h[1] += h[0] >> 51; h[0] &= MASK51;
+    h[2] += h[1] >> 51; h[1] &= MASK51;
+    h[3] += h[2] >> 51; h[2] &= MASK51;
+    h[4] += h[3] >> 51; h[3] &= MASK51;
+    h[4] &= MASK51;
+
+    w[0] = h[0] | (h[1] << 51);
+    w[1] = (h[1] >> 13) | (h[2] << 38);
+    w[2] = (h[2] >> 26) | (h[3] << 25);
+    w[3] = (h[3] >> 39) | (h[4] << 12);
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 8; j++) {
+            s[8 * i + j] = (uint8_t)(w[i] >> (8 * j));
+        }
+    }
+}
+
+/*
+ * return 1 if f is in {1,3,5,...,q-2}
+ * return 0 if f is in {0,2,4,...,q-1}
+ */
+static inline int fe51_isnegative(const fe51 f)
+{
+    uint8_t s[32];
+
+    fe51_tobytes(s, f);
+    return s[0] & 1;
+}
+
+/*
+ * out = z ** -1, with the addition chain of fe_invert. gfe_invert uses
+ * safegcd instead; this one is the reference the unit test checks it with.
+ */
+static inline void fe51_invert(fe51 out, const fe51 z)
+{
+    fe51 t0;
+    fe51 t1;
+    fe51 t2;
+    fe51 t3;
+    int i;
+
+    fe51_sq(t0, z);
+    fe51_sq(t1, t0);
+    fe51_sq(t1, t1);
+    fe51_mul(t1, z, t1);
+    fe51_mul(t0, t0, t1);
+    fe51_sq(t2, t0);
+    fe51_mul(t1, t1, t2);
+    fe51_sq(t2, t1);
+    for (i = 1; i < 5; ++i) {
+        fe51_sq(t2, t2);
+    }
+    fe51_mul(t1, t2, t1);
+    fe51_sq(t2, t1);
+    for (i = 1; i < 10; ++i) {
+        fe51_sq(t2, t2);
+    }
+    fe51_mul(t2, t2, t1);
+    fe51_sq(t3, t2);
+    for (i = 1; i < 20; ++i) {
+        fe51_sq(t3, t3);
+    }
+    fe51_mul(t2, t3, t2);
+    for (i = 0; i < 10; ++i) {
+        fe51_sq(t2, t2);
+    }
+    fe51_mul(t1, t2, t1);
+    fe51_sq(t2, t1);
+    for (i = 1; i < 50; ++i) {
+        fe51_sq(t2, t2);
+    }
+    fe51_mul(t2, t2, t1);
+    fe51_sq(t3, t2);
+    for (i = 1; i < 100; ++i) {
+        fe51_sq(t3, t3);
+    }
+    fe51_mul(t2, t3, t2);
+    fe51_sq(t2, t2);
+    for (i = 1; i < 50; ++i) {
+        fe51_sq(t2, t2);
+    }
+    fe51_mul(t1, t2, t1);
+    fe51_sq(t1, t1);
+    for (i = 1; i < 5; ++i) {
+        fe51_sq(t1, t1);
+    }
+    fe51_mul(out, t1, t0);
+}
 
 #endif
 
@@ -436,6 +1056,13 @@ static void fe_tobytes(uint8_t *s, const fe h)
     s[31] = (uint8_t) (h9 >> 18);
 }
 
+/*
+ * The remaining ref10 field operations serve the 2^25.5 group operations
+ * and the generic X25519 ladder only; the 2^51 build (GE_BASE_2_51, set
+ * below) just converts the ref10 tables with fe_tobytes.
+ */
+#if !defined(BASE_2_51_IMPLEMENTED) || defined(GE_BASE_2_25_5)
+
 /* h = f */
 static void fe_copy(fe h, const fe f)
 {
@@ -1192,6 +1819,361 @@ static void fe_sq2(fe h, const fe f)
     h[8] = (int32_t)h8;
     h[9] = (int32_t)h9;
 }
+#endif /* !BASE_2_51_IMPLEMENTED || GE_BASE_2_25_5 */
+
+/*
+ * Field elements of the group operations below. They use the base 2^51
+ * implementation (five 64-bit limbs, 128-bit products) where it is
+ * available, which takes about half the time of the reference base 2^25.5
+ * one on 64-bit targets; define GE_BASE_2_25_5 to force the reference.
+ *
+ * On x86-64 CPUs with BMI2 and ADX, the base 2^64 subroutines are faster
+ * still. Whether the CPU has them is checked once at startup and every
+ * field operation then branches on that (well predicted) flag, so one
+ * portable build runs the fastest backend of the machine it lands on;
+ * define GE_NO_FE64 to leave them out. Both store elements in the same
+ * five 64-bit limbs, base 2^64 only using the first four.
+ */
+#if defined(BASE_2_51_IMPLEMENTED) && !defined(GE_BASE_2_25_5)
+# define GE_BASE_2_51
+
+typedef fe51 gfe;
+
+# if defined(BASE_2_64_IMPLEMENTED)
+#  define GE_BASE_2_64
+
+static const bool ge_fe64 = x25519_fe64_eligible() != 0;
+
+#  define GE_FE(op51, op64) (ge_fe64 ? op64 : op51)
+# else
+#  define GE_FE(op51, op64) (op51)
+# endif
+
+# define gfe_0(h) GE_FE(fe51_0(h), fe64_0(h))
+# define gfe_1(h) GE_FE(fe51_1(h), fe64_1(h))
+# define gfe_copy(h, f) GE_FE(fe51_copy(h, f), fe64_copy(h, f))
+# define gfe_add(h, f, g) GE_FE(fe51_add(h, f, g), fe64_add(h, f, g))
+# define gfe_sub(h, f, g) GE_FE(fe51_sub(h, f, g), fe64_sub(h, f, g))
+# define gfe_neg(h, f) GE_FE(fe51_neg(h, f), fe64_neg(h, f))
+# define gfe_mul(h, f, g) GE_FE(fe51_mul(h, f, g), fe64_mul(h, f, g))
+# define gfe_sq(h, f) GE_FE(fe51_sq(h, f), fe64_sqr(h, f))
+# define gfe_sq2(h, f) GE_FE(fe51_sq2(h, f), fe64_sq2(h, f))
+/* safegcd, defined below; fe51_invert and fe64_invert use Fermat */
+# define gfe_invert(h, f) gfe_invert_safegcd(h, f)
+# define gfe_cmov(f, g, b) GE_FE(fe51_cmov(f, g, b), fe64_cmov(f, g, b))
+# define gfe_isnegative(f) GE_FE(fe51_isnegative(f), fe64_isnegative(f))
+# define gfe_frombytes(h, s) GE_FE(fe51_frombytes(h, s), fe64_frombytes(h, s))
+# define gfe_tobytes(s, f) GE_FE(fe51_tobytes(s, f), fe64_tobytes(s, f))
+
+/*
+ * Name of the field backend the group operations run on.
+ */
+static inline const char *ge_backend_name()
+{
+    return GE_FE("fe51", "fe64");
+}
+#else
+typedef fe gfe;
+
+# define gfe_0 fe_0
+# define gfe_1 fe_1
+# define gfe_copy fe_copy
+# define gfe_add fe_add
+# define gfe_sub fe_sub
+# define gfe_neg fe_neg
+# define gfe_mul fe_mul
+# define gfe_sq fe_sq
+# define gfe_sq2 fe_sq2
+# define gfe_invert fe_invert
+# define gfe_cmov fe_cmov
+# define gfe_isnegative fe_isnegative
+# define gfe_tobytes fe_tobytes
+
+static inline const char *ge_backend_name()
+{
+    return "fe";
+}
+#endif
+
+#if defined(GE_BASE_2_51)
+/*
+ * Field inversion with the safegcd algorithm of Bernstein and Yang
+ * ("Fast constant-time gcd computation and modular inversion", 2019), in
+ * the formulation of libsecp256k1's modinv64: integers are held in five
+ * signed 62-bit limbs, divsteps run on the low 64 bits only, and the
+ * 2x2 transition matrix of each batch of divsteps is then applied to the
+ * full-length f, g (the gcd state) and d, e (the Bezout coefficients).
+ */
+typedef struct {
+    int64_t v[5];
+} fe_s62;
+
+typedef struct {
+    int64_t u, v, q, r;
+} fe_s62_trans;
+
+#define FE_S62_M62 (UINT64_MAX >> 2)
+
+/* p = 2^255 - 19 as signed limbs, and p^-1 mod 2^62 */
+static const fe_s62 fe_s62_modulus = {{-19, 0, 0, 0, 128}};
+static const uint64_t fe_s62_modulus_inv62 = 0x39435e50d79435e5ULL;
+
+static void fe_s62_from_bytes(fe_s62 *r, const uint8_t s[32])
+{
+    uint64_t w[4] = {0, 0, 0, 0};
+    int i;
+
+    for (i = 0; i < 32; i++)
+        w[i / 8] |= (uint64_t)s[i] << (8 * (i % 8));
+    r->v[0] = w[0] & FE_S62_M62;
+    r->v[1] = ((w[0] >> 62) | (w[1] << 2)) & FE_S62_M62;
+    r->v[2] = ((w[1] >> 60) | (w[2] << 4)) & FE_S62_M62;
+    r->v[3] = ((w[2] >> 58) | (w[3] << 6)) & FE_S62_M62;
+    r->v[4] = w[3] >> 56;
+}
+
+/* r is in [0, p) */
+static void fe_s62_to_bytes(uint8_t s[32], const fe_s62 *r)
+{
+    uint64_t w[4];
+    int i;
+
+    w[0] = (uint64_t)r->v[0] | ((uint64_t)r->v[1] << 62);
+    w[1] = ((uint64_t)r->v[1] >> 2) | ((uint64_t)r->v[2] << 60);
+    w[2] = ((uint64_t)r->v[2] >> 4) | ((uint64_t)r->v[3] << 58);
+    w[3] = ((uint64_t)r->v[3] >> 6) | ((uint64_t)r->v[4] << 56);
+    for (i = 0; i < 32; i++)
+        s[i] = (uint8_t)(w[i / 8] >> (8 * (i % 8)));
+}
+
+/*
+ * 59 constant-time divsteps on the low bits of f, g, starting from
+ * zeta = -(delta + 1/2). The matrix is scaled by 2^62.
+ */
+static int64_t fe_s62_divsteps_59(int64_t zeta, uint64_t f, uint64_t g,
+                                  fe_s62_trans *t)
+{
+    uint64_t u = 8, v = 0, q = 0, r = 8;
+    uint64_t c1, c2, x, y, z;
+    int i;
+
+    for (i = 3; i < 62; i++) {
+        /* c1 = zeta < 0, c2 = g odd, as all-ones masks */
+        c1 = (uint64_t)(zeta >> 63);
+        c2 = -(g & 1);
+        x = (f ^ c1) - c1;
+        y = (u ^ c1) - c1;
+        z = (v ^ c1) - c1;
+        g += x & c2;
+        q += y & c2;
+        r += z & c2;
+        c1 &= c2;
+        zeta = (zeta ^ (int64_t)c1) - 1;
+        f += g & c1;
+        u += q & c1;
+        v += r & c1;
+        g >>= 1;
+        u <<= 1;
+        v <<= 1;
+    }
+    t->u = (int64_t)u;
+    t->v = (int64_t)v;
+    t->q = (int64_t)q;
+    t->r = (int64_t)r;
+    return zeta;
+}
+
+/*
+ * Up to 62 divsteps on the low bits of f, g, starting from
+ * eta = -delta, skipping over runs of zeros of g. The matrix is scaled
+ * by 2^62.
+ */
+static int64_t fe_s62_divsteps_62_var(int64_t eta, uint64_t f, uint64_t g,
+                                      fe_s62_trans *t)
+{
+    uint64_t u = 1, v = 0, q = 0, r = 1;
+    uint64_t m, w, tmp;
+    int i = 62, limit, zeros;
+
+    for (;;) {
+        /* The sentinel bit stops the count at the i divsteps left */
+        zeros = __builtin_ctzll(g | (UINT64_MAX << i));
+        g >>= zeros;
+        u <<= zeros;
+        v <<= zeros;
+        eta -= zeros;
+        i -= zeros;
+        if (i == 0)
+            break;
+        limit = ((int)eta + 1) > i ? i : ((int)eta + 1);
+        if (eta < 0) {
+            /* (f, g) = (g, -f), then cancel up to 6 bits of g */
+            eta = -eta;
+            tmp = f; f = g; g = -tmp;
+            tmp = u; u = q; q = -tmp;
+            tmp = v; v = r; r = -tmp;
+            limit = ((int)eta + 1) > i ? i : ((int)eta + 1);
+            m = (UINT64_MAX >> (64 - limit)) & 63U;
+            /* f (f^2 - 2) = -1/f mod 64 */
+            w = (f * g * (f * f - 2)) & m;
+        } else {
+            /* Up to 4 bits; f + ((f + 1) & 4) * 2 = 1/f mod 16 */
+            m = (UINT64_MAX >> (64 - limit)) & 15U;
+            w = f + (((f + 1) & 4) << 1);
+            w = (-w * g) & m;
+        }
+        g += f * w;
+        q += u * w;
+        r += v * w;
+    }
+    t->u = (int64_t)u;
+    t->v = (int64_t)v;
+    t->q = (int64_t)q;
+    t->r = (int64_t)r;
+    return eta;
+}
+
+/*
+ * (d, e) = t (d, e) / 2^62 mod p, adding to each the multiple of p that
+ * makes the division exact. d, e stay in (-2p, p).
+ */
+static void fe_s62_update_de(fe_s62 *d, fe_s62 *e, const fe_s62_trans *t)
+{
+    const int64_t u = t->u, v = t->v, q = t->q, r = t->r;
+    int64_t md, me, sd, se;
+    __int128 cd, ce;
+    int i;
+
+    /* Start from p times the sign corrections that keep d, e in range */
+    sd = d->v[4] >> 63;
+    se = e->v[4] >> 63;
+    md = (u & sd) + (v & se);
+    me = (q & sd) + (r & se);
+    cd = (__int128)u * d->v[0] + (__int128)v * e->v[0];
+    ce = (__int128)q * d->v[0] + (__int128)r * e->v[0];
+    md -= (int64_t)((fe_s62_modulus_inv62 * (uint64_t)cd + (uint64_t)md) & FE_S62_M62);
+    me -= (int64_t)((fe_s62_modulus_inv62 * (uint64_t)ce + (uint64_t)me) & FE_S62_M62);
+    cd += (__int128)fe_s62_modulus.v[0] * md;
+    ce += (__int128)fe_s62_modulus.v[0] * me;
+    /* The low 62 bits are now zero */
+    cd >>= 62;
+    ce >>= 62;
+    for (i = 1; i < 5; i++) {
+        cd += (__int128)u * d->v[i] + (__int128)v * e->v[i];
+        ce += (__int128)q * d->v[i] + (__int128)r * e->v[i];
+        /* Limbs 1 to 3 of p are zero */
+        if (i == 4) {
+            cd += (__int128)fe_s62_modulus.v[4] * md;
+            ce += (__int128)fe_s62_modulus.v[4] * me;
+        }
+        d->v[i - 1] = (int64_t)((uint64_t)cd & FE_S62_M62);
+        e->v[i - 1] = (int64_t)((uint64_t)ce & FE_S62_M62);
+        cd >>= 62;
+        ce >>= 62;
+    }
+    d->v[4] = (int64_t)cd;
+    e->v[4] = (int64_t)ce;
+}
+
+/* (f, g) = t (f, g) / 2^62, exactly */
+static void fe_s62_update_fg(fe_s62 *f, fe_s62 *g, const fe_s62_trans *t)
+{
+    const int64_t u = t->u, v = t->v, q = t->q, r = t->r;
+    __int128 cf, cg;
+    int i;
+
+    cf = (__int128)u * f->v[0] + (__int128)v * g->v[0];
+    cg = (__int128)q * f->v[0] + (__int128)r * g->v[0];
+    cf >>= 62;
+    cg >>= 62;
+    for (i = 1; i < 5; i++) {
+        cf += (__int128)u * f->v[i] + (__int128)v * g->v[i];
+        cg += (__int128)q * f->v[i] + (__int128)r * g->v[i];
+        f->v[i - 1] = (int64_t)((uint64_t)cf & FE_S62_M62);
+        g->v[i - 1] = (int64_t)((uint64_t)cg & FE_S62_M62);
+        cf >>= 62;
+        cg >>= 62;
+    }
+    f->v[4] = (int64_t)cf;
+    g->v[4] = (int64_t)cg;
+}
+
+/* r = r (negated if sign < 0) mod p in [0, p), for r in (-2p, p) */
+static void fe_s62_normalize(fe_s62 *r, int64_t sign)
+{
+    int64_t cond_add, cond_negate;
+    int i, round;
+
+    cond_negate = sign >> 63;
+    for (round = 0; round < 2; round++) {
+        cond_add = r->v[4] >> 63;
+        for (i = 0; i < 5; i++)
+            r->v[i] += fe_s62_modulus.v[i] & cond_add;
+        if (round == 0) {
+            for (i = 0; i < 5; i++)
+                r->v[i] = (r->v[i] ^ cond_negate) - cond_negate;
+        }
+        for (i = 0; i < 4; i++) {
+            r->v[i + 1] += r->v[i] >> 62;
+            r->v[i] &= (int64_t)FE_S62_M62;
+        }
+    }
+}
+
+/*
+ * out = z ** -1 (0 for z = 0) in constant time: ten batches of 59
+ * divsteps cover the 590 needed for any input below 2^256.
+ */
+static void gfe_invert_safegcd(gfe out, const gfe z)
+{
+    fe_s62 d = {{0, 0, 0, 0, 0}}, e = {{1, 0, 0, 0, 0}}, f = fe_s62_modulus, g;
+    fe_s62_trans t;
+    int64_t zeta = -1;
+    uint8_t s[32];
+    int i;
+
+    gfe_tobytes(s, z);
+    fe_s62_from_bytes(&g, s);
+    for (i = 0; i < 10; i++) {
+        zeta = fe_s62_divsteps_59(zeta, (uint64_t)f.v[0], (uint64_t)g.v[0], &t);
+        fe_s62_update_de(&d, &e, &t);
+        fe_s62_update_fg(&f, &g, &t);
+    }
+    /* g is now 0 and f = +-1, so d = +-z^-1 */
+    fe_s62_normalize(&d, f.v[4]);
+    fe_s62_to_bytes(s, &d);
+    gfe_frombytes(out, s);
+}
+
+/*
+ * Same as gfe_invert_safegcd, in variable time: it stops as soon as g
+ * reaches 0, and skips runs of zero bits. Only for public values.
+ */
+static void gfe_invert_vartime(gfe out, const gfe z)
+{
+    fe_s62 d = {{0, 0, 0, 0, 0}}, e = {{1, 0, 0, 0, 0}}, f = fe_s62_modulus, g;
+    fe_s62_trans t;
+    int64_t eta = -1;
+    uint8_t s[32];
+
+    gfe_tobytes(s, z);
+    fe_s62_from_bytes(&g, s);
+    for (;;) {
+        eta = fe_s62_divsteps_62_var(eta, (uint64_t)f.v[0], (uint64_t)g.v[0], &t);
+        fe_s62_update_de(&d, &e, &t);
+        fe_s62_update_fg(&f, &g, &t);
+        if ((g.v[0] | g.v[1] | g.v[2] | g.v[3] | g.v[4]) == 0)
+            break;
+    }
+    fe_s62_normalize(&d, f.v[4]);
+    fe_s62_to_bytes(s, &d);
+    gfe_frombytes(out, s);
+}
+
+# undef FE_S62_M62
+#else
+# define gfe_invert_vartime gfe_invert
+#endif
 
 /*
  * ge means group element.
@@ -1207,175 +2189,297 @@ static void fe_sq2(fe h, const fe f)
  *   ge_precomp (Duif): (y+x,y-x,2dxy)
  */
 typedef struct {
-    fe X;
-    fe Y;
-    fe Z;
+    gfe X;
+    gfe Y;
+    gfe Z;
 } ge_p2;
 
 typedef struct {
-    fe X;
-    fe Y;
-    fe Z;
-    fe T;
+    gfe X;
+    gfe Y;
+    gfe Z;
+    gfe T;
 } ge_p3;
 
 typedef struct {
-    fe X;
-    fe Y;
-    fe Z;
-    fe T;
+    gfe X;
+    gfe Y;
+    gfe Z;
+    gfe T;
 } ge_p1p1;
 
+typedef struct {
+    gfe yplusx;
+    gfe yminusx;
+    gfe xy2d;
+} ge_precomp;
+
+/*
+ * ge_precomp in base 2^25.5, the format of the literal tables
+ * k25519Precomp and Bi. With the 64-bit limb backends, these and the
+ * constants d, sqrtm1 and d2 are converted once at load time, by the
+ * backend chosen then (see ge_tables_init).
+ */
+#if defined(GE_BASE_2_51)
 typedef struct {
     fe yplusx;
     fe yminusx;
     fe xy2d;
-} ge_precomp;
+} ge_precomp25;
+
+# define GE_TABLE_25(name) name##_25
+#else
+typedef ge_precomp ge_precomp25;
+
+# define GE_TABLE_25(name) name
+#endif
 
 typedef struct {
-    fe YplusX;
-    fe YminusX;
-    fe Z;
-    fe T2d;
+    gfe YplusX;
+    gfe YminusX;
+    gfe Z;
+    gfe T2d;
 } ge_cached;
 
-static void ge_tobytes(uint8_t *s, const ge_p2 *h)
+static inline void ge_tobytes(uint8_t *s, const ge_p2 *h)
 {
-    fe recip;
-    fe x;
-    fe y;
-
-    fe_invert(recip, h->Z);
-    fe_mul(x, h->X, recip);
-    fe_mul(y, h->Y, recip);
-    fe_tobytes(s, y);
-    s[31] ^= fe_isnegative(x) << 7;
+    gfe recip;
+    gfe x;
+    gfe y;
+
+    gfe_invert(recip, h->Z);
+    gfe_mul(x, h->X, recip);
+    gfe_mul(y, h->Y, recip);
+    gfe_tobytes(s, y);
+    s[31] ^= gfe_isnegative(x) << 7;
 }
 
 static void ge_p3_tobytes(uint8_t *s, const ge_p3 *h)
 {
-    fe recip;
-    fe x;
-    fe y;
-
-    fe_invert(recip, h->Z);
-    fe_mul(x, h->X, recip);
-    fe_mul(y, h->Y, recip);
-    fe_tobytes(s, y);
-    s[31] ^= fe_isnegative(x) << 7;
+    gfe recip;
+    gfe x;
+    gfe y;
+
+    gfe_invert(recip, h->Z);
+    gfe_mul(x, h->X, recip);
+    gfe_mul(y, h->Y, recip);
+    gfe_tobytes(s, y);
+    s[31] ^= gfe_isnegative(x) << 7;
+}
+
+/*
+ * out[i] = in[i] ** -1 for i = 0..n-1, using one gfe_invert_vartime and
+ * 3(n-1) multiplications (Montgomery's simultaneous inversion).
+ *
+ * out may alias in. scratch must hold n elements. Not constant time.
+ * Preconditions: no in[i] is zero.
+ */
+static void gfe_batch_invert(gfe *out, const gfe *in, gfe *scratch, size_t n)
+{
+    gfe acc;
+    gfe t;
+    size_t i;
+
+    if (n == 0)
+        return;
+
+    /* scratch[i] = in[0] * ... * in[i] */
+    gfe_copy(scratch[0], in[0]);
+    for (i = 1; i < n; ++i) {
+        gfe_mul(scratch[i], scratch[i - 1], in[i]);
+    }
+
+    /* acc = (in[0] * ... * in[i]) ** -1, peeled off one element at a time */
+    gfe_invert_vartime(acc, scratch[n - 1]);
+    for (i = n - 1; i > 0; --i) {
+        gfe_mul(t, acc, scratch[i - 1]);
+        gfe_mul(acc, acc, in[i]);
+        gfe_copy(out[i], t);
+    }
+    gfe_copy(out[0], acc);
 }
 
-static const fe d = {
+/*
+ * Same as ge_p3_tobytes on each of h[0..n-1], writing 32 bytes per point
+ * to s, but sharing a single field inversion across the whole batch.
+ * Meant for public points (table entries, decryption candidates), as the
+ * inversion runs in variable time.
+ *
+ * scratch must hold 2*n elements.
+ */
+static void ge_p3_batch_tobytes(uint8_t *s, const ge_p3 *h, gfe *scratch,
+                                size_t n)
+{
+    gfe *recip = scratch;
+    gfe x;
+    gfe y;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        gfe_copy(recip[i], h[i].Z);
+    }
+    gfe_batch_invert(recip, recip, scratch + n, n);
+
+    for (i = 0; i < n; ++i) {
+        gfe_mul(x, h[i].X, recip[i]);
+        gfe_mul(y, h[i].Y, recip[i]);
+        gfe_tobytes(s + 32 * i, y);
+        s[32 * i + 31] ^= gfe_isnegative(x) << 7;
+    }
+}
+
+static const fe GE_TABLE_25(d) = {
     -10913610, 13857413, -15372611, 6949391,   114729,
     -8787816,  -6275908, -3247719,  -18696448, -12055116
 };
 
-static const fe sqrtm1 = {
+static const fe GE_TABLE_25(sqrtm1) = {
     -32595792, -7943725,  9377950,  3500415, 12389472,
     -272473,   -25146209, -2005654, 326686,  11406482
 };
 
+#if defined(GE_BASE_2_51)
+static gfe d;
+static gfe sqrtm1;
+#endif
+
 
 static void ge_p2_0(ge_p2 *h)
 {
-    fe_0(h->X);
-    fe_1(h->Y);
-    fe_1(h->Z);
+    gfe_0(h->X);
+    gfe_1(h->Y);
+    gfe_1(h->Z);
 }
 
 static void ge_p3_0(ge_p3 *h)
 {
-    fe_0(h->X);
-    fe_1(h->Y);
-    fe_1(h->Z);
-    fe_0(h->T);
+    gfe_0(h->X);
+    gfe_1(h->Y);
+    gfe_1(h->Z);
+    gfe_0(h->T);
 }
 
-static void ge_precomp_0(ge_precomp *h)
+/*
+ * r = -p, as -(x,y) = (-x,y)
+ */
+static void ge_p3_neg(ge_p3 *r, const ge_p3 *p)
 {
-    fe_1(h->yplusx);
-    fe_1(h->yminusx);
-    fe_0(h->xy2d);
+    gfe_neg(r->X, p->X);
+    gfe_copy(r->Y, p->Y);
+    gfe_copy(r->Z, p->Z);
+    gfe_neg(r->T, p->T);
 }
 
-/* r = p */
-static void ge_p3_to_p2(ge_p2 *r, const ge_p3 *p)
+static void ge_precomp_0(ge_precomp *h)
 {
-    fe_copy(r->X, p->X);
-    fe_copy(r->Y, p->Y);
-    fe_copy(r->Z, p->Z);
+    gfe_1(h->yplusx);
+    gfe_1(h->yminusx);
+    gfe_0(h->xy2d);
 }
 
-/* [Zico Add] */
-/* This might be slow due to the invert operation. */
 /* r = p */
-static void ge_p2_to_p3(ge_p3 *r, const ge_p2 *p)
+static void ge_p3_to_p2(ge_p2 *r, const ge_p3 *p)
 {
-    fe_copy(r->X, p->X);
-    fe_copy(r->Y, p->Y);
-    fe_copy(r->Z, p->Z);
-
-    fe recip;
-    fe_invert(recip, r->Z);
-
-    fe_mul(r->T, r->X, r->Y);
-    fe_mul(r->T, r->T, recip);
+    gfe_copy(r->X, p->X);
+    gfe_copy(r->Y, p->Y);
+    gfe_copy(r->Z, p->Z);
 }
 
-static const fe d2 = {
+static const fe GE_TABLE_25(d2) = {
     -21827239, -5839606,  -30745221, 13898782, 229458,
     15978800,  -12551817, -6495438,  29715968, 9444199
 };
 
+#if defined(GE_BASE_2_51)
+static gfe d2;
+#endif
+
 /* r = p */
 static void ge_p3_to_cached(ge_cached *r, const ge_p3 *p)
 {
-    fe_add(r->YplusX, p->Y, p->X);
-    fe_sub(r->YminusX, p->Y, p->X);
-    fe_copy(r->Z, p->Z);
-    fe_mul(r->T2d, p->T, d2);
+    gfe_add(r->YplusX, p->Y, p->X);
+    gfe_sub(r->YminusX, p->Y, p->X);
+    gfe_copy(r->Z, p->Z);
+    gfe_mul(r->T2d, p->T, d2);
 }
 
-/* [Zico Add] */
-/* r = p */
-static void ge_p2_to_cached(ge_cached *r, const ge_p2 *p)
+/*
+ * r = p in the affine (y+x, y-x, 2dxy) form ge_madd and ge_msub take,
+ * costing one field inversion; see ge_p3_batch_to_precomp for many points.
+ */
+static void ge_p3_to_precomp(ge_precomp *r, const ge_p3 *p)
 {
-    ge_p3 tmp;
-    ge_p2_to_p3(&tmp, p);
-    ge_p3_to_cached(r, &tmp);
+    gfe recip;
+    gfe x;
+    gfe y;
+
+    gfe_invert(recip, p->Z);
+    gfe_mul(x, p->X, recip);
+    gfe_mul(y, p->Y, recip);
+    gfe_add(r->yplusx, y, x);
+    gfe_sub(r->yminusx, y, x);
+    gfe_mul(r->xy2d, x, y);
+    gfe_mul(r->xy2d, r->xy2d, d2);
+}
+
+/*
+ * Same as ge_p3_to_precomp on each of p[0..n-1], sharing one field
+ * inversion in variable time. scratch must hold 2*n elements.
+ */
+static void ge_p3_batch_to_precomp(ge_precomp *r, const ge_p3 *p, gfe *scratch,
+                                   size_t n)
+{
+    gfe *recip = scratch;
+    gfe x;
+    gfe y;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        gfe_copy(recip[i], p[i].Z);
+    }
+    gfe_batch_invert(recip, recip, scratch + n, n);
+
+    for (i = 0; i < n; ++i) {
+        gfe_mul(x, p[i].X, recip[i]);
+        gfe_mul(y, p[i].Y, recip[i]);
+        gfe_add(r[i].yplusx, y, x);
+        gfe_sub(r[i].yminusx, y, x);
+        gfe_mul(r[i].xy2d, x, y);
+        gfe_mul(r[i].xy2d, r[i].xy2d, d2);
+    }
 }
 
 /* r = p */
 static void ge_p1p1_to_p2(ge_p2 *r, const ge_p1p1 *p)
 {
-    fe_mul(r->X, p->X, p->T);
-    fe_mul(r->Y, p->Y, p->Z);
-    fe_mul(r->Z, p->Z, p->T);
+    gfe_mul(r->X, p->X, p->T);
+    gfe_mul(r->Y, p->Y, p->Z);
+    gfe_mul(r->Z, p->Z, p->T);
 }
 
 /* r = p */
 static void ge_p1p1_to_p3(ge_p3 *r, const ge_p1p1 *p)
 {
-    fe_mul(r->X, p->X, p->T);
-    fe_mul(r->Y, p->Y, p->Z);
-    fe_mul(r->Z, p->Z, p->T);
-    fe_mul(r->T, p->X, p->Y);
+    gfe_mul(r->X, p->X, p->T);
+    gfe_mul(r->Y, p->Y, p->Z);
+    gfe_mul(r->Z, p->Z, p->T);
+    gfe_mul(r->T, p->X, p->Y);
 }
 
 /* r = 2 * p */
 static void ge_p2_dbl(ge_p1p1 *r, const ge_p2 *p)
 {
-    fe t0;
-
-    fe_sq(r->X, p->X);
-    fe_sq(r->Z, p->Y);
-    fe_sq2(r->T, p->Z);
-    fe_add(r->Y, p->X, p->Y);
-    fe_sq(t0, r->Y);
-    fe_add(r->Y, r->Z, r->X);
-    fe_sub(r->Z, r->Z, r->X);
-    fe_sub(r->X, t0, r->Y);
-    fe_sub(r->T, r->T, r->Z);
+    gfe t0;
+
+    gfe_sq(r->X, p->X);
+    gfe_sq(r->Z, p->Y);
+    gfe_sq2(r->T, p->Z);
+    gfe_add(r->Y, p->X, p->Y);
+    gfe_sq(t0, r->Y);
+    gfe_add(r->Y, r->Z, r->X);
+    gfe_sub(r->Z, r->Z, r->X);
+    gfe_sub(r->X, t0, r->Y);
+    gfe_sub(r->T, r->T, r->Z);
 }
 
 /* r = 2 * p */
@@ -1389,71 +2493,71 @@ static void ge_p3_dbl(ge_p1p1 *r, const ge_p3 *p)
 /* r = p + q */
 static void ge_madd(ge_p1p1 *r, const ge_p3 *p, const ge_precomp *q)
 {
-    fe t0;
-
-    fe_add(r->X, p->Y, p->X);
-    fe_sub(r->Y, p->Y, p->X);
-    fe_mul(r->Z, r->X, q->yplusx);
-    fe_mul(r->Y, r->Y, q->yminusx);
-    fe_mul(r->T, q->xy2d, p->T);
-    fe_add(t0, p->Z, p->Z);
-    fe_sub(r->X, r->Z, r->Y);
-    fe_add(r->Y, r->Z, r->Y);
-    fe_add(r->Z, t0, r->T);
-    fe_sub(r->T, t0, r->T);
+    gfe t0;
+
+    gfe_add(r->X, p->Y, p->X);
+    gfe_sub(r->Y, p->Y, p->X);
+    gfe_mul(r->Z, r->X, q->yplusx);
+    gfe_mul(r->Y, r->Y, q->yminusx);
+    gfe_mul(r->T, q->xy2d, p->T);
+    gfe_add(t0, p->Z, p->Z);
+    gfe_sub(r->X, r->Z, r->Y);
+    gfe_add(r->Y, r->Z, r->Y);
+    gfe_add(r->Z, t0, r->T);
+    gfe_sub(r->T, t0, r->T);
 }
 
 /* r = p - q */
 static void ge_msub(ge_p1p1 *r, const ge_p3 *p, const ge_precomp *q)
 {
-    fe t0;
-
-    fe_add(r->X, p->Y, p->X);
-    fe_sub(r->Y, p->Y, p->X);
-    fe_mul(r->Z, r->X, q->yminusx);
-    fe_mul(r->Y, r->Y, q->yplusx);
-    fe_mul(r->T, q->xy2d, p->T);
-    fe_add(t0, p->Z, p->Z);
-    fe_sub(r->X, r->Z, r->Y);
-    fe_add(r->Y, r->Z, r->Y);
-    fe_sub(r->Z, t0, r->T);
-    fe_add(r->T, t0, r->T);
+    gfe t0;
+
+    gfe_add(r->X, p->Y, p->X);
+    gfe_sub(r->Y, p->Y, p->X);
+    gfe_mul(r->Z, r->X, q->yminusx);
+    gfe_mul(r->Y, r->Y, q->yplusx);
+    gfe_mul(r->T, q->xy2d, p->T);
+    gfe_add(t0, p->Z, p->Z);
+    gfe_sub(r->X, r->Z, r->Y);
+    gfe_add(r->Y, r->Z, r->Y);
+    gfe_sub(r->Z, t0, r->T);
+    gfe_add(r->T, t0, r->T);
 }
 
 /* r = p + q */
 static void ge_add(ge_p1p1 *r, const ge_p3 *p, const ge_cached *q)
 {
-    fe t0;
-
-    fe_add(r->X, p->Y, p->X);
-    fe_sub(r->Y, p->Y, p->X);
-    fe_mul(r->Z, r->X, q->YplusX);
-    fe_mul(r->Y, r->Y, q->YminusX);
-    fe_mul(r->T, q->T2d, p->T);
-    fe_mul(r->X, p->Z, q->Z);
-    fe_add(t0, r->X, r->X);
-    fe_sub(r->X, r->Z, r->Y);
-    fe_add(r->Y, r->Z, r->Y);
-    fe_add(r->Z, t0, r->T);
-    fe_sub(r->T, t0, r->T);
+    gfe t0;
+
+    gfe_add(r->X, p->Y, p->X);
+    gfe_sub(r->Y, p->Y, p->X);
+    gfe_mul(r->Z, r->X, q->YplusX);
+    gfe_mul(r->Y, r->Y, q->YminusX);
+    gfe_mul(r->T, q->T2d, p->T);
+    gfe_mul(r->X, p->Z, q->Z);
+    gfe_add(t0, r->X, r->X);
+    gfe_sub(r->X, r->Z, r->Y);
+    gfe_add(r->Y, r->Z, r->Y);
+    gfe_add(r->Z, t0, r->T);
+    gfe_sub(r->T, t0, r->T);
 }
 
 /* r = p - q */
 static void ge_sub(ge_p1p1 *r, const ge_p3 *p, const ge_cached *q)
 {
-    fe t0;
-
-    fe_add(r->X, p->Y, p->X);
-    fe_sub(r->Y, p->Y, p->X);
-    fe_mul(r->Z, r->X, q->YminusX);
-    fe_mul(r->Y, r->Y, q->YplusX);
-    fe_mul(r->T, q->T2d, p->T);
-    fe_mul(r->X, p->Z, q->Z);
-    fe_add(t0, r->X, r->X);
-    fe_sub(r->X, r->Z, r->Y);
-    fe_add(r->Y, r->Z, r->Y);
-    fe_sub(r->Z, t0, r->T);
-    fe_add(r->T, t0, r->T);
+    gfe t0;
+
+    gfe_add(r->X, p->Y, p->X);
+    gfe_sub(r->Y, p->Y, p->X);
+    gfe_mul(r->Z, r->X, q->YminusX);
+    gfe_mul(r->Y, r->Y, q->YplusX);
+    gfe_mul(r->T, q->T2d, p->T);
+    gfe_mul(r->X, p->Z, q->Z);
+    gfe_add(t0, r->X, r->X);
+    gfe_sub(r->X, r->Z, r->Y);
+    gfe_add(r->Y, r->Z, r->Y);
+    gfe_sub(r->Z, t0, r->T);
+    gfe_add(r->T, t0, r->T);
 }
 
 static uint8_t equal(signed char b, signed char c)
@@ -1469,13 +2573,13 @@ static uint8_t equal(signed char b, signed char c)
 
 static void cmov(ge_precomp *t, const ge_precomp *u, uint8_t b)
 {
-    fe_cmov(t->yplusx, u->yplusx, b);
-    fe_cmov(t->yminusx, u->yminusx, b);
-    fe_cmov(t->xy2d, u->xy2d, b);
+    gfe_cmov(t->yplusx, u->yplusx, b);
+    gfe_cmov(t->yminusx, u->yminusx, b);
+    gfe_cmov(t->xy2d, u->xy2d, b);
 }
 
 /* k25519Precomp[i][j] = (j+1)*256^i*B */
-static const ge_precomp k25519Precomp[32][8] = {
+static const ge_precomp25 GE_TABLE_25(k25519Precomp)[32][8] = {
     {
         {
             {25967493, -14356035, 29566456, 3660896, -12694345, 4014787,
@@ -3590,6 +4694,10 @@ static const ge_precomp k25519Precomp[32][8] = {
     },
 };
 
+#if defined(GE_BASE_2_51)
+static ge_precomp k25519Precomp[32][8];
+#endif
+
 static uint8_t negative(signed char b)
 {
     uint32_t x = b;
@@ -3598,37 +4706,39 @@ static uint8_t negative(signed char b)
     return x;
 }
 
-static void table_select(ge_precomp *t, int pos, signed char b)
+/* table is k25519Precomp or one built by ge_precompute_table */
+static void table_select(ge_precomp *t, const ge_precomp table[][8], int pos,
+                         signed char b)
 {
     ge_precomp minust;
     uint8_t bnegative = negative(b);
     uint8_t babs = b - ((uint8_t)((-bnegative) & b) << 1);
 
     ge_precomp_0(t);
-    cmov(t, &k25519Precomp[pos][0], equal(babs, 1));
-    cmov(t, &k25519Precomp[pos][1], equal(babs, 2));
-    cmov(t, &k25519Precomp[pos][2], equal(babs, 3));
-    cmov(t, &k25519Precomp[pos][3], equal(babs, 4));
-    cmov(t, &k25519Precomp[pos][4], equal(babs, 5));
-    cmov(t, &k25519Precomp[pos][5], equal(babs, 6));
-    cmov(t, &k25519Precomp[pos][6], equal(babs, 7));
-    cmov(t, &k25519Precomp[pos][7], equal(babs, 8));
-    fe_copy(minust.yplusx, t->yminusx);
-    fe_copy(minust.yminusx, t->yplusx);
-    fe_neg(minust.xy2d, t->xy2d);
+    cmov(t, &table[pos][0], equal(babs, 1));
+    cmov(t, &table[pos][1], equal(babs, 2));
+    cmov(t, &table[pos][2], equal(babs, 3));
+    cmov(t, &table[pos][3], equal(babs, 4));
+    cmov(t, &table[pos][4], equal(babs, 5));
+    cmov(t, &table[pos][5], equal(babs, 6));
+    cmov(t, &table[pos][6], equal(babs, 7));
+    cmov(t, &table[pos][7], equal(babs, 8));
+    gfe_copy(minust.yplusx, t->yminusx);
+    gfe_copy(minust.yminusx, t->yplusx);
+    gfe_neg(minust.xy2d, t->xy2d);
     cmov(t, &minust, bnegative);
 }
 
 /*
- * h = a * B
- *
- * where a = a[0]+256*a[1]+...+256^31 a[31]
- * B is the Ed25519 base point (x,4/5) with x positive.
+ * h = a * A, for table[i][j] = (j+1)*256^i*A as built by
+ * ge_precompute_table, and a of len bytes: a short a only walks the first
+ * len rows of the table. Same as ge_scalarmult_base otherwise.
  *
  * Preconditions:
- *   a[31] <= 127
+ *   1 <= len <= 32, a[len-1] <= 127
  */
-static void ge_scalarmult_base(ge_p3 *h, const uint8_t *a)
+static void ge_scalarmult_table_short(ge_p3 *h, const uint8_t *a, int len,
+                                      const ge_precomp table[][8])
 {
     signed char e[64];
     signed char carry;
@@ -3637,26 +4747,26 @@ static void ge_scalarmult_base(ge_p3 *h, const uint8_t *a)
     ge_precomp t;
     int i;
 
-    for (i = 0; i < 32; ++i) {
+    for (i = 0; i < len; ++i) {
         e[2 * i + 0] = (a[i] >> 0) & 15;
         e[2 * i + 1] = (a[i] >> 4) & 15;
     }
     /* each e[i] is between 0 and 15 */
-    /* e[63] is between 0 and 7 */
+    /* e[2*len-1] is between 0 and 7 */
 
     carry = 0;
-    for (i = 0; i < 63; ++i) {
+    for (i = 0; i < 2 * len - 1; ++i) {
         e[i] += carry;
         carry = e[i] + 8;
         carry >>= 4;
         e[i] -= carry << 4;
     }
-    e[63] += carry;
+    e[2 * len - 1] += carry;
     /* each e[i] is between -8 and 8 */
 
     ge_p3_0(h);
-    for (i = 1; i < 64; i += 2) {
-        table_select(&t, i / 2, e[i]);
+    for (i = 1; i < 2 * len; i += 2) {
+        table_select(&t, table, i / 2, e[i]);
         ge_madd(&r, h, &t);
         ge_p1p1_to_p3(h, &r);
     }
@@ -3670,8 +4780,8 @@ static void ge_scalarmult_base(ge_p3 *h, const uint8_t *a)
     ge_p2_dbl(&r, &s);
     ge_p1p1_to_p3(h, &r);
 
-    for (i = 0; i < 64; i += 2) {
-        table_select(&t, i / 2, e[i]);
+    for (i = 0; i < 2 * len; i += 2) {
+        table_select(&t, table, i / 2, e[i]);
         ge_madd(&r, h, &t);
         ge_p1p1_to_p3(h, &r);
     }
@@ -3679,6 +4789,62 @@ static void ge_scalarmult_base(ge_p3 *h, const uint8_t *a)
     //OPENSSL_cleanse(e, sizeof(e));
 }
 
+/* h = a * A, a of 32 bytes */
+static void ge_scalarmult_table(ge_p3 *h, const uint8_t *a,
+                                const ge_precomp table[][8])
+{
+    ge_scalarmult_table_short(h, a, 32, table);
+}
+
+/*
+ * h = a * B
+ *
+ * where a = a[0]+256*a[1]+...+256^31 a[31]
+ * B is the Ed25519 base point (x,4/5) with x positive.
+ *
+ * Preconditions:
+ *   a[31] <= 127
+ */
+static void ge_scalarmult_base(ge_p3 *h, const uint8_t *a)
+{
+    ge_scalarmult_table(h, a, k25519Precomp);
+}
+
+/*
+ * table[i][j] = (j+1)*256^i*A, the layout of k25519Precomp, for
+ * ge_scalarmult_table. The 256 entries share one field inversion, in
+ * variable time, so A must be public.
+ *
+ * scratch must hold 256 points and 512 field elements.
+ */
+static void ge_precompute_table(ge_precomp table[32][8], const ge_p3 *A,
+                                ge_p3 *points, gfe *scratch)
+{
+    ge_p1p1 r;
+    ge_p2 s;
+    ge_cached row;
+    int i, j, k;
+
+    points[0] = *A;
+    for (i = 0; i < 32; ++i) {
+        if (i > 0) {
+            /* 256^i*A = 2^8 * 256^(i-1)*A */
+            ge_p3_dbl(&r, &points[8 * (i - 1)]);
+            for (k = 1; k < 8; ++k) {
+                ge_p1p1_to_p2(&s, &r);
+                ge_p2_dbl(&r, &s);
+            }
+            ge_p1p1_to_p3(&points[8 * i], &r);
+        }
+        ge_p3_to_cached(&row, &points[8 * i]);
+        for (j = 1; j < 8; ++j) {
+            ge_add(&r, &points[8 * i + j - 1], &row);
+            ge_p1p1_to_p3(&points[8 * i + j], &r);
+        }
+    }
+    ge_p3_batch_to_precomp(&table[0][0], points, scratch, 256);
+}
+
 #if !defined(BASE_2_51_IMPLEMENTED)
 /*
  * Replace (f,g) with (g,f) if b == 1;
@@ -3859,7 +5025,7 @@ static void slide(signed char *r, const uint8_t *a)
     }
 }
 
-static const ge_precomp Bi[8] = {
+static const ge_precomp25 GE_TABLE_25(Bi)[8] = {
     {
         {25967493, -14356035, 29566456, 3660896, -12694345, 4014787, 27544626,
          -11754271, -6079156, 2047605},
@@ -3926,6 +5092,45 @@ static const ge_precomp Bi[8] = {
     },
 };
 
+#if defined(GE_BASE_2_51)
+static ge_precomp Bi[8];
+
+static void gfe_from25(gfe h, const fe f)
+{
+    uint8_t s[32];
+
+    fe_tobytes(s, f);
+    gfe_frombytes(h, s);
+}
+
+static void ge_precomp_from25(ge_precomp *r, const ge_precomp25 *p)
+{
+    gfe_from25(r->yplusx, p->yplusx);
+    gfe_from25(r->yminusx, p->yminusx);
+    gfe_from25(r->xy2d, p->xy2d);
+}
+
+static bool ge_tables_init()
+{
+    int i, j;
+
+    gfe_from25(d, d_25);
+    gfe_from25(sqrtm1, sqrtm1_25);
+    gfe_from25(d2, d2_25);
+    for (i = 0; i < 32; i++) {
+        for (j = 0; j < 8; j++) {
+            ge_precomp_from25(&k25519Precomp[i][j], &k25519Precomp_25[i][j]);
+        }
+    }
+    for (i = 0; i < 8; i++) {
+        ge_precomp_from25(&Bi[i], &Bi_25[i]);
+    }
+    return true;
+}
+
+static const bool ge_tables_ready = ge_tables_init();
+#endif
+
 /*
  * r = a * A + b * B
  *
@@ -3933,8 +5138,8 @@ static const ge_precomp Bi[8] = {
  * and b = b[0]+256*b[1]+...+256^31 b[31].
  * B is the Ed25519 base point (x,4/5) with x positive.
  */
-static void ge_double_scalarmult_vartime(ge_p2 *r, const uint8_t *a,
-                                         const ge_p3 *A, const uint8_t *b)
+static inline void ge_double_scalarmult_vartime(ge_p2 *r, const uint8_t *a,
+                                                const ge_p3 *A, const uint8_t *b)
 {
     signed char aslide[256];
     signed char bslide[256];
@@ -4081,6 +5286,118 @@ static void ge_double_scalarmult_vartime(ge_p3 *r, const uint8_t *a,
     }
 }
 
+/*
+ * Signed digits of a, naf[i] for i < the returned length: plain binary
+ * for w = 1, else width-w NAF, whose nonzero digits are odd, below 2^(w-1)
+ * in magnitude and at least w positions apart.
+ * a must be below 2^64 - 2^w.
+ */
+static int ge_small_recode(signed char *naf, uint64_t a, int w)
+{
+    int64_t d;
+    int len = 0;
+
+    while (a != 0) {
+        d = (int64_t)(a & 1);
+        if (w > 1 && d) {
+            d = (int64_t)(a & ((1u << w) - 1));
+            if (d >= (1 << (w - 1))) {
+                d -= 1 << w;
+            }
+        }
+        a -= (uint64_t)d;
+        naf[len++] = (signed char)d;
+        a >>= 1;
+    }
+    return len;
+}
+
+/*
+ * r = a * A for a 64-bit a, in variable time.
+ *
+ * a is recoded in binary or in width-w NAF, whichever takes the fewest
+ * doublings and additions, counting the 2^(w-2) odd multiples of A to
+ * build for w > 2. A 16-bit a takes 15 doublings and about 5 additions,
+ * where ge_double_scalarmult_vartime builds a table of 8 multiples first
+ * and a negative scalar mod l has 253 bits. Small constants get short
+ * addition chains: 3A is one doubling and one addition, 10A three
+ * doublings and one addition, 100A six doublings and two additions.
+ * Runs of doublings stay in ge_p2.
+ */
+static void ge_scalarmult_small_vartime(ge_p3 *r, uint64_t a, const ge_p3 *A)
+{
+    signed char naf[66], digits[66];
+    ge_cached Ai[8]; /* A,3A,5A,...,(2^(w-1)-1)A */
+    ge_p3 top;
+    ge_p1p1 t;
+    ge_p2 s;
+    ge_p3 u;
+    ge_p3 A2;
+    int w, best, cost, best_cost, len, n, i;
+
+    if (a == 0) {
+        ge_p3_0(r);
+        return;
+    }
+
+    /* a is at most 2^63 for any int64 magnitude */
+    best = 1;
+    best_cost = 0;
+    len = 0;
+    for (w = 1; w <= 5; ++w) {
+        n = ge_small_recode(digits, a, w);
+        cost = n - 1;
+        for (i = 0; i < n - 1; ++i) {
+            cost += digits[i] != 0;
+        }
+        if (w > 2) {
+            cost += 1 << (w - 2);
+        }
+        if (w == 1 || cost < best_cost) {
+            best = w;
+            best_cost = cost;
+            len = n;
+            memcpy(naf, digits, n);
+        }
+    }
+    w = best;
+
+    /* the top digit is positive: start from its multiple */
+    top = *A;
+    ge_p3_to_cached(&Ai[0], A);
+    if (w > 2) {
+        ge_p3_dbl(&t, A);
+        ge_p1p1_to_p3(&A2, &t);
+        for (i = 1; i < (1 << (w - 2)); ++i) {
+            ge_add(&t, &A2, &Ai[i - 1]);
+            ge_p1p1_to_p3(&u, &t);
+            ge_p3_to_cached(&Ai[i], &u);
+            if (i == naf[len - 1] / 2) {
+                top = u;
+            }
+        }
+    }
+    *r = top;
+
+    for (i = len - 2; i >= 0; --i) {
+        ge_p3_dbl(&t, r);
+        for (; i > 0 && naf[i] == 0; --i) {
+            ge_p1p1_to_p2(&s, &t);
+            ge_p2_dbl(&t, &s);
+        }
+
+        if (naf[i] > 0) {
+            ge_p1p1_to_p3(&u, &t);
+            ge_add(&t, &u, &Ai[naf[i] / 2]);
+        } else if (naf[i] < 0) {
+            ge_p1p1_to_p3(&u, &t);
+            ge_sub(&t, &u, &Ai[(-naf[i]) / 2]);
+        }
+
+        ge_p1p1_to_p3(r, &t);
+    }
+}
+
 /*
  * The set of scalars is \Z/l
  * where l = 2^252 + 27742317777372353535851937790883648493.
@@ -0,0 +1,349 @@
+/*
+ * Copyright 2019 Zhicong Huang (zhicong303@gmail.com). All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution.
+ */
+
+#ifndef DECRYPTION_TABLE_H
+#define DECRYPTION_TABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <stdexcept>
+#include "lookup_table.h"
+#include "table_file.h"
+#include "table_memory.h"
+
+/*
+ * Default split, used when a table is built without an explicit one and
+ * when loading tables in the old record format, which does not store it.
+ */
+#define MSG_BITS 40
+#define BABY_BITS 15
+
+/*
+ * Giant-step table for baby-step-giant-step decryption, together with the
+ * bit split it was built for.
+ *
+ * A message m of msg_bits bits (sign included) is written as
+ * m = m1*2^{baby_bits} + m0, where 0 <= m0 <= 2^{baby_bits}-1 and
+ * -2^{giant_bits-1} <= m1 <= 2^{giant_bits-1}-1, giant_bits = msg_bits - baby_bits.
+ * The table stores the 2^{giant_bits} points m1*2^{baby_bits}*G and
+ * decryption walks at most 2^{baby_bits} baby steps, so each extra bit of
+ * baby_bits halves the table and doubles the worst-case decryption time.
+ *
+ * P and -P only differ in the sign of x, and lookups only read bytes of y,
+ * so a symmetric table stores just the 2^{giant_bits-1}+1 points with
+ * 0 <= m1 <= 2^{giant_bits-1}: a hit on m1 stands for +m1 or -m1, and the
+ * sign bit of the probed point tells which. This halves the table for the
+ * same split, or covers one more message bit with the same memory.
+ *
+ * The placement (see table_memory.h) decides the pages of the table and
+ * whether threads probe a replica on their own NUMA node; it takes effect
+ * when the table is built, loaded or mapped after set_placement.
+ */
+class DecryptionTable {
+
+public:
+    DecryptionTable() {}
+
+    /*
+     * Drop the current content and make room for a table with the given
+     * split. Entries (giant steps min_giant_step() to max_giant_step())
+     * are then added through lookup().
+     */
+    void reset(int msg_bits, int baby_bits, bool symmetric = false) {
+        check_bits(msg_bits, baby_bits, symmetric);
+
+        mapping_.reset();
+        replicas_.clear();
+        msg_bits_ = msg_bits;
+        baby_bits_ = baby_bits;
+        symmetric_ = symmetric;
+        lookup_.reserve((size_t)(max_giant_step() - min_giant_step() + 1));
+    }
+
+    int msg_bits() const {
+        return msg_bits_;
+    }
+
+    int baby_bits() const {
+        return baby_bits_;
+    }
+
+    int giant_bits() const {
+        return msg_bits_ - baby_bits_;
+    }
+
+    bool symmetric() const {
+        return symmetric_;
+    }
+
+    int64_t min_giant_step() const {
+        return symmetric_ ? 0 : -(1LL << (giant_bits() - 1));
+    }
+
+    int64_t max_giant_step() const {
+        return symmetric_ ? 1LL << (giant_bits() - 1) : (1LL << (giant_bits() - 1)) - 1;
+    }
+
+    bool empty() const {
+        return lookup_.size() == 0;
+    }
+
+    LookupTable& lookup() {
+        return lookup_;
+    }
+
+    /*
+     * The copy of the table on the NUMA node of the calling thread if
+     * there are replicas, the table itself otherwise.
+     */
+    const LookupTable& lookup() const {
+        if (!replicas_.empty()) {
+            const LookupTable& replica = replicas_[numa_current_node() % replicas_.size()];
+            if (replica.bucket_count() > 0)
+                return replica;
+        }
+        return lookup_;
+    }
+
+    void set_placement(const TablePlacement& placement) {
+        placement_ = placement;
+        lookup_.set_memory(placement.pages);
+    }
+
+    const TablePlacement& placement() const {
+        return placement_;
+    }
+
+    /*
+     * Apply the placement to the entries in place: load and map call this,
+     * and whoever fills the table through lookup() does once it is full.
+     *
+     * With numa_replicas on a host with several NUMA nodes, a table in
+     * memory moves to node 0 and every other node gets its own copy; a
+     * mapped table stays where the page cache has it, and every node gets
+     * a copy. Huge pages of mapped files and shared memory segments are
+     * only asked for (MADV_HUGEPAGE), as the kernel may not back them so.
+     */
+    void place() {
+        replicas_.clear();
+        if (lookup_.bucket_count() == 0)
+            return;
+
+        size_t bytes = lookup_.bucket_count() * sizeof(LookupBucket);
+        if (!lookup_.owned())
+            table_memory_advise(lookup_.buckets(), bytes, placement_.pages);
+
+        int nodes = numa_node_count();
+        if (placement_.numa_replicas && nodes > 1) {
+            replicas_.resize(nodes);
+            for (int node = 0; node < nodes; node++) {
+                if (node == 0 && lookup_.owned()) {
+                    lookup_.move_to_node(0);
+                    continue;
+                }
+                replicas_[node].set_memory(placement_.pages, node);
+                replicas_[node].copy_buckets(lookup_);
+            }
+        }
+
+        if (placement_.prefault) {
+            table_memory_prefault(lookup_.buckets(), bytes);
+            for (size_t i = 0; i < replicas_.size(); i++)
+                table_memory_prefault(replicas_[i].buckets(),
+                                      replicas_[i].bucket_count() * sizeof(LookupBucket));
+        }
+    }
+
+    /* Number of NUMA replicas in use, 0 if the table is probed directly */
+    size_t replica_count() const {
+        size_t count = 0;
+        for (size_t i = 0; i < replicas_.size(); i++)
+            count += replicas_[i].bucket_count() > 0 ? 1 : 0;
+        return count;
+    }
+
+    /*
+     * Write the table in the format described in table_file.h.
+     */
+    void save(std::ostream& stream) const {
+        TableHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = TABLE_MAGIC;
+        header.version = TABLE_VERSION;
+        header.msg_bits = msg_bits_;
+        header.baby_bits = baby_bits_;
+        header.flags = symmetric_ ? TABLE_FLAG_SYMMETRIC : 0;
+        header.num_entries = lookup_.size();
+        header.num_buckets = lookup_.bucket_count();
+        header.checksum = table_checksum(lookup_.buckets(), lookup_.bucket_count());
+
+        stream.write((const char*)&header, sizeof(header));
+        stream.write((const char*)lookup_.buckets(), lookup_.bucket_count() * sizeof(LookupBucket));
+    }
+
+    /*
+     * Read a table written by save into memory, verifying its checksum,
+     * and adopt the split recorded in it. The older format of
+     * (32-byte point, int) records preceded by their count is still
+     * accepted and taken to use the default split. Either is read into a
+     * new table first, so that a failed load leaves this one as it was.
+     */
+    void load(std::istream& stream) {
+        TableHeader header;
+        stream.read((char*)&header, sizeof(uint64_t));
+        if (!stream)
+            throw std::runtime_error("Decryption table file is truncated");
+
+        if (header.magic == TABLE_MAGIC) {
+            stream.read((char*)&header + sizeof(uint64_t), sizeof(header) - sizeof(uint64_t));
+            if (!stream)
+                throw std::runtime_error("Decryption table file is truncated");
+            check_header(header);
+
+            // Do not allocate for buckets that a seekable stream does not hold
+            std::streampos start = stream.tellg();
+            if (start != std::streampos(-1)) {
+                stream.seekg(0, std::ios::end);
+                std::streamoff available = stream.tellg() - start;
+                stream.seekg(start);
+                if (available < (std::streamoff)(header.num_buckets * sizeof(LookupBucket)))
+                    throw std::runtime_error("Decryption table file is truncated");
+            }
+
+            LookupTable loaded;
+            loaded.set_memory(placement_.pages);
+            LookupBucket* raw = loaded.assign_raw(header.num_buckets, header.num_entries);
+            stream.read((char*)raw, header.num_buckets * sizeof(LookupBucket));
+            if (!stream || table_checksum(raw, header.num_buckets) != header.checksum)
+                throw std::runtime_error("Decryption table checksum mismatch");
+            adopt(loaded, header.msg_bits, header.baby_bits, header.flags & TABLE_FLAG_SYMMETRIC);
+            return;
+        }
+
+        size_t n = (size_t)header.magic;
+        DecryptionTable legacy;
+        legacy.set_placement(placement_);
+        legacy.reset(MSG_BITS, BABY_BITS);
+        uint8_t buf[32];
+        int step = 0;
+        for (size_t i = 0; i < n; i++) {
+            stream.read((char*)buf, 32);
+            stream.read((char*)&step, sizeof(int));
+            if (!stream)
+                throw std::runtime_error("Decryption table file is truncated");
+            legacy.lookup_.insert(buf, step);
+        }
+        adopt(legacy.lookup_, MSG_BITS, BABY_BITS, false);
+    }
+
+    /*
+     * Use a table file written by save directly from a read-only shared
+     * mapping instead of reading it into memory: startup costs no I/O up
+     * front, and processes on one host share the page-cache copy.
+     * Verifying the checksum reads the whole file, so it is optional.
+     */
+    void map(const std::string& path, bool verify_checksum = false) {
+        std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>(path);
+        view_image(mapping->data(), mapping->size(), mapping, verify_checksum);
+    }
+
+    /*
+     * Probe a table image of size bytes at data, laid out as the file
+     * written by save (header then buckets), in place: map and the shared
+     * memory segments of TableRegistry come here. owner keeps the memory
+     * valid for as long as the table, or a copy of it, holds on to it.
+     */
+    void view_image(const uint8_t* data, size_t size, const std::shared_ptr<const void>& owner,
+                    bool verify_checksum = false) {
+        if (size < sizeof(TableHeader))
+            throw std::runtime_error("Decryption table file is truncated");
+
+        const TableHeader* header = reinterpret_cast<const TableHeader*>(data);
+        check_header(*header, size);
+
+        const LookupBucket* buckets = reinterpret_cast<const LookupBucket*>(data + sizeof(TableHeader));
+        if (verify_checksum && table_checksum(buckets, header->num_buckets) != header->checksum)
+            throw std::runtime_error("Decryption table checksum mismatch");
+
+        replicas_.clear();
+        lookup_.view(buckets, header->num_buckets, header->num_entries);
+        mapping_ = owner;
+        msg_bits_ = header->msg_bits;
+        baby_bits_ = header->baby_bits;
+        symmetric_ = header->flags & TABLE_FLAG_SYMMETRIC;
+        place();
+    }
+
+    /*
+     * Throws unless header is valid (see check_table_header) and describes
+     * a table as built for its split: exactly as many buckets as reserve
+     * makes for its giant steps, which bounds what a header can make a
+     * reader allocate and keeps the load factor, and at most that many
+     * entries.
+     */
+    static void check_header(const TableHeader& header, size_t file_size = 0) {
+        bool symmetric = header.flags & TABLE_FLAG_SYMMETRIC;
+        check_table_header(header, file_size);
+        check_bits(header.msg_bits, header.baby_bits, symmetric);
+
+        int giant_bits = header.msg_bits - header.baby_bits;
+        uint64_t giant_steps = symmetric ? (1ULL << (giant_bits - 1)) + 1 : 1ULL << giant_bits;
+        if (header.num_buckets != LookupTable::buckets_for(giant_steps) ||
+            header.num_entries > giant_steps)
+            throw std::runtime_error("Corrupted decryption table header");
+    }
+
+    /*
+     * Messages are limited to 40 bits (see LHE25519::encode), giant-step
+     * indices are stored as int32 (a symmetric table goes up to
+     * +2^{giant_bits-1}, hence one bit less) and baby steps are counted
+     * in an int.
+     */
+    static void check_bits(int msg_bits, int baby_bits, bool symmetric = false) {
+        if (msg_bits < 2 || msg_bits > 40)
+            throw std::invalid_argument("Message bits must be in [2, 40]");
+        if (baby_bits < 1 || baby_bits >= msg_bits || baby_bits > 30)
+            throw std::invalid_argument("Baby bits must be in [1, min(msg_bits-1, 30)]");
+        if (msg_bits - baby_bits > 32)
+            throw std::invalid_argument("Giant bits must be at most 32");
+        if (symmetric && msg_bits - baby_bits > 31)
+            throw std::invalid_argument("Giant bits of a symmetric table must be at most 31");
+    }
+
+private:
+    /* Take over the entries of a table read by load, and its split */
+    void adopt(LookupTable& loaded, int msg_bits, int baby_bits, bool symmetric) {
+        lookup_.swap(loaded);
+        mapping_.reset();
+        msg_bits_ = msg_bits;
+        baby_bits_ = baby_bits;
+        symmetric_ = symmetric;
+        place();
+    }
+
+    int msg_bits_ = MSG_BITS;
+    int baby_bits_ = BABY_BITS;
+    bool symmetric_ = false;
+
+    LookupTable lookup_;
+
+    TablePlacement placement_;
+
+    /* replicas_[node] is probed from that node, unless it is empty (lookup_ is) */
+    std::vector<LookupTable> replicas_;
+
+    /* Keeps the memory behind lookup_ valid when it comes from view_image */
+    std::shared_ptr<const void> mapping_;
+};
+
+#endif // DECRYPTION_TABLE_H
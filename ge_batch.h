@@ -0,0 +1,867 @@
+/*
+ * Copyright 2019 Zhicong Huang (zhicong303@gmail.com). All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution.
+ */
+
+#ifndef GE_BATCH_H
+#define GE_BATCH_H
+
+#include <stddef.h>
+#include "curve25519.h"
+
+/*
+ * Batched group operations: r[i] = p[i] + q[i] (or p[i] - q[i], or 2 p[i])
+ * for i < n, already converted to ge_p3. r may alias p.
+ *
+ * On x86-64 CPUs with AVX2 (checked once at startup), four operations run
+ * at once, one per 64-bit lane, on field elements in base 2^25.5 as in the
+ * reference field: limbs are 32-bit so each 4x32->64-bit vpmuludq does the
+ * multiplication of four elements, and inputs and outputs are converted
+ * from and to the 64-bit limb backends on the fly. Otherwise, and for the
+ * last n % 4 operations, they loop over the scalar group operations.
+ * CPUs with AVX-512 IFMA first take eight operations at a time, on field
+ * elements in base 2^51 multiplied with vpmadd52luq/vpmadd52huq.
+ * Define GE_NO_AVX2 or GE_NO_IFMA to leave either vector code out.
+ */
+
+/* Operations done at once; callers with a choice batch at least this many */
+#define GE_BATCH_WIDTH 8
+
+#if defined(GE_BASE_2_51) && defined(__GNUC__) && !defined(GE_NO_AVX2) \
+    && (defined(__x86_64) || defined(__x86_64__))
+# define GE_BATCH_AVX2
+
+# include <immintrin.h>
+
+# define GE_AVX2_FN static inline __attribute__((target("avx2")))
+
+static bool ge_avx2_eligible()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static const bool ge_avx2 = ge_avx2_eligible();
+
+/*
+ * Limb i of four field elements. Limbs alternate 26 and 25 bits; outside
+ * of fe4_mul they are kept below 2^26 + 2^8 (resp. 2^25 + 2^8) and
+ * non-negative, so products of two limbs times 38 and their sums fit in
+ * 64 bits, and 19 times a limb fits in the 32 bits vpmuludq reads.
+ */
+typedef __m256i fe4[10];
+
+# define FE4_MASK26 _mm256_set1_epi64x(0x3ffffff)
+# define FE4_MASK25 _mm256_set1_epi64x(0x1ffffff)
+
+/* 19 * c, c too large for vpmuludq */
+GE_AVX2_FN __m256i fe4_times19(__m256i c)
+{
+    return _mm256_add_epi64(c, _mm256_add_epi64(_mm256_slli_epi64(c, 1),
+                                                _mm256_slli_epi64(c, 4)));
+}
+
+/* One carry from every limb to the next at once, limbs below 2^26 + 2^8 */
+GE_AVX2_FN void fe4_reduce(fe4 h)
+{
+    __m256i c[10];
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        c[i] = _mm256_srli_epi64(h[i], (i & 1) ? 25 : 26);
+        h[i] = _mm256_and_si256(h[i], (i & 1) ? FE4_MASK25 : FE4_MASK26);
+    }
+    h[0] = _mm256_add_epi64(h[0], fe4_times19(c[9]));
+    for (i = 1; i < 10; i++)
+        h[i] = _mm256_add_epi64(h[i], c[i - 1]);
+}
+
+GE_AVX2_FN void fe4_add(fe4 h, const fe4 f, const fe4 g)
+{
+    int i;
+
+    for (i = 0; i < 10; i++)
+        h[i] = _mm256_add_epi64(f[i], g[i]);
+    fe4_reduce(h);
+}
+
+/* h = f + 2p - g, as g < 2p limb by limb */
+GE_AVX2_FN void fe4_sub(fe4 h, const fe4 f, const fe4 g)
+{
+    int i;
+
+    h[0] = _mm256_sub_epi64(_mm256_add_epi64(f[0], _mm256_set1_epi64x(0x7ffffda)), g[0]);
+    for (i = 1; i < 10; i++) {
+        h[i] = _mm256_sub_epi64(_mm256_add_epi64(f[i], _mm256_set1_epi64x(
+                                    (i & 1) ? 0x3fffffe : 0x7fffffe)), g[i]);
+    }
+    fe4_reduce(h);
+}
+
+/* h = acc carried as at the end of fe_mul */
+GE_AVX2_FN void fe4_mul_carry(fe4 h, __m256i acc[10])
+{
+    __m256i c;
+    int i;
+
+# define FE4_CARRY(a, b, bits)                                  \
+    c = _mm256_srli_epi64(acc[a], bits);                        \
+    acc[b] = _mm256_add_epi64(acc[b], c);                       \
+    acc[a] = _mm256_and_si256(acc[a], bits == 26 ? FE4_MASK26 : FE4_MASK25)
+
+    FE4_CARRY(0, 1, 26);
+    FE4_CARRY(4, 5, 26);
+    FE4_CARRY(1, 2, 25);
+    FE4_CARRY(5, 6, 25);
+    FE4_CARRY(2, 3, 26);
+    FE4_CARRY(6, 7, 26);
+    FE4_CARRY(3, 4, 25);
+    FE4_CARRY(7, 8, 25);
+    FE4_CARRY(4, 5, 26);
+    FE4_CARRY(8, 9, 26);
+    c = _mm256_srli_epi64(acc[9], 25);
+    acc[0] = _mm256_add_epi64(acc[0], fe4_times19(c));
+    acc[9] = _mm256_and_si256(acc[9], FE4_MASK25);
+    FE4_CARRY(0, 1, 26);
+
+# undef FE4_CARRY
+
+    for (i = 0; i < 10; i++)
+        h[i] = acc[i];
+}
+
+/*
+ * Same products and carry chain as fe_mul, on unsigned limbs. Rows of the
+ * schoolbook product go one limb of g at a time, so the ten accumulators
+ * and the current limb of g stay in registers.
+ */
+GE_AVX2_FN void fe4_mul(fe4 h, const fe4 f, const fe4 g)
+{
+    const __m256i n19 = _mm256_set1_epi64x(19);
+    __m256i f2[10], acc[10], gj, gj19;
+    int i, j;
+
+    for (i = 1; i < 10; i += 2)
+        f2[i] = _mm256_add_epi64(f[i], f[i]);
+    for (i = 0; i < 10; i++)
+        acc[i] = _mm256_setzero_si256();
+
+#pragma GCC unroll 10
+    for (j = 0; j < 10; j++) {
+        gj = g[j];
+        gj19 = _mm256_mul_epu32(gj, n19);
+#pragma GCC unroll 10
+        for (i = 0; i < 10; i++) {
+            /* f[i] g[j] 2^(...) has weight 2 when i and j are odd, 19 once past 2^255 */
+            __m256i t = _mm256_mul_epu32((i & j & 1) ? f2[i] : f[i],
+                                         i + j >= 10 ? gj19 : gj);
+            acc[(i + j) % 10] = _mm256_add_epi64(acc[(i + j) % 10], t);
+        }
+    }
+
+    fe4_mul_carry(h, acc);
+}
+
+/* h = f * f, as fe4_mul with the symmetric products counted once */
+GE_AVX2_FN void fe4_sq(fe4 h, const fe4 f)
+{
+    const __m256i n19 = _mm256_set1_epi64x(19);
+    __m256i f2[10], f19[10], f38[10], acc[10];
+    int i, j;
+
+    for (i = 0; i < 10; i++) {
+        f2[i] = _mm256_add_epi64(f[i], f[i]);
+        f19[i] = _mm256_mul_epu32(f[i], n19);
+        f38[i] = _mm256_add_epi64(f19[i], f19[i]);
+        acc[i] = _mm256_setzero_si256();
+    }
+
+#pragma GCC unroll 10
+    for (i = 0; i < 10; i++) {
+#pragma GCC unroll 10
+        for (j = i; j < 10; j++) {
+            __m256i a = i == j ? f[i] : f2[i];
+            __m256i b = i + j >= 10 ? ((i & j & 1) ? f38[j] : f19[j])
+                                    : ((i & j & 1) ? f2[j] : f[j]);
+            acc[(i + j) % 10] = _mm256_add_epi64(acc[(i + j) % 10], _mm256_mul_epu32(a, b));
+        }
+    }
+
+    fe4_mul_carry(h, acc);
+}
+
+
+/* Transpose limbs 0..3 of four 64-bit limb elements into w[0..3] */
+GE_AVX2_FN void fe4_transpose(__m256i w[4])
+{
+    __m256i t0 = _mm256_unpacklo_epi64(w[0], w[1]);
+    __m256i t1 = _mm256_unpackhi_epi64(w[0], w[1]);
+    __m256i t2 = _mm256_unpacklo_epi64(w[2], w[3]);
+    __m256i t3 = _mm256_unpackhi_epi64(w[2], w[3]);
+
+    w[0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+    w[1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+    w[2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+    w[3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+}
+
+/* h = (a, b, c, d), elements of the backend chosen by ge_tables_init */
+GE_AVX2_FN void fe4_load(fe4 h, const uint64_t *a, const uint64_t *b,
+                         const uint64_t *c, const uint64_t *d)
+{
+    __m256i w[4];
+
+    w[0] = _mm256_loadu_si256((const __m256i *)a);
+    w[1] = _mm256_loadu_si256((const __m256i *)b);
+    w[2] = _mm256_loadu_si256((const __m256i *)c);
+    w[3] = _mm256_loadu_si256((const __m256i *)d);
+    fe4_transpose(w);
+
+# if defined(GE_BASE_2_64)
+    if (ge_fe64) {
+        /* limb i holds bits 0, 26, 51, 77, 102, 128, 153, 179, 204, 230 on */
+        h[0] = _mm256_and_si256(w[0], FE4_MASK26);
+        h[1] = _mm256_and_si256(_mm256_srli_epi64(w[0], 26), FE4_MASK25);
+        h[2] = _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(w[0], 51),
+                                                _mm256_slli_epi64(w[1], 13)), FE4_MASK26);
+        h[3] = _mm256_and_si256(_mm256_srli_epi64(w[1], 13), FE4_MASK25);
+        h[4] = _mm256_srli_epi64(w[1], 38);
+        h[5] = _mm256_and_si256(w[2], FE4_MASK25);
+        h[6] = _mm256_and_si256(_mm256_srli_epi64(w[2], 25), FE4_MASK26);
+        h[7] = _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(w[2], 51),
+                                                _mm256_slli_epi64(w[3], 13)), FE4_MASK25);
+        h[8] = _mm256_and_si256(_mm256_srli_epi64(w[3], 12), FE4_MASK26);
+        h[9] = _mm256_and_si256(_mm256_srli_epi64(w[3], 38), FE4_MASK25);
+        /* bit 255, 2^255 = 19 */
+        h[0] = _mm256_add_epi64(h[0], fe4_times19(_mm256_srli_epi64(w[3], 63)));
+        return;
+    }
+# endif
+
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        h[2 * i] = _mm256_and_si256(w[i], FE4_MASK26);
+        h[2 * i + 1] = _mm256_srli_epi64(w[i], 26);
+    }
+    w[0] = _mm256_set_epi64x(d[4], c[4], b[4], a[4]);
+    h[8] = _mm256_and_si256(w[0], FE4_MASK26);
+    h[9] = _mm256_srli_epi64(w[0], 26);
+}
+
+/*
+ * (a, b, c, d) = f, f as left by fe4_mul: all limbs are exact but for
+ * limbs 1 and 5, so one pass of carries from limb 1 leaves only limb 9
+ * possibly at 2^25, which both 64-bit limb backends absorb.
+ */
+GE_AVX2_FN void fe4_store(uint64_t *a, uint64_t *b, uint64_t *c, uint64_t *d,
+                          const fe4 f)
+{
+    fe4 h;
+    __m256i w[4], carry;
+    int i;
+
+    for (i = 0; i < 10; i++)
+        h[i] = f[i];
+    for (i = 1; i < 9; i++) {
+        carry = _mm256_srli_epi64(h[i], (i & 1) ? 25 : 26);
+        h[i] = _mm256_and_si256(h[i], (i & 1) ? FE4_MASK25 : FE4_MASK26);
+        h[i + 1] = _mm256_add_epi64(h[i + 1], carry);
+    }
+
+# if defined(GE_BASE_2_64)
+    if (ge_fe64) {
+        w[0] = _mm256_or_si256(_mm256_or_si256(h[0], _mm256_slli_epi64(h[1], 26)),
+                               _mm256_slli_epi64(h[2], 51));
+        w[1] = _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi64(h[2], 13),
+                                               _mm256_slli_epi64(h[3], 13)),
+                               _mm256_slli_epi64(h[4], 38));
+        w[2] = _mm256_or_si256(_mm256_or_si256(h[5], _mm256_slli_epi64(h[6], 25)),
+                               _mm256_slli_epi64(h[7], 51));
+        w[3] = _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi64(h[7], 13),
+                                               _mm256_slli_epi64(h[8], 12)),
+                               _mm256_slli_epi64(h[9], 38));
+        fe4_transpose(w);
+        _mm256_storeu_si256((__m256i *)a, w[0]);
+        _mm256_storeu_si256((__m256i *)b, w[1]);
+        _mm256_storeu_si256((__m256i *)c, w[2]);
+        _mm256_storeu_si256((__m256i *)d, w[3]);
+        return;
+    }
+# endif
+
+    for (i = 0; i < 4; i++)
+        w[i] = _mm256_or_si256(h[2 * i], _mm256_slli_epi64(h[2 * i + 1], 26));
+    fe4_transpose(w);
+    _mm256_storeu_si256((__m256i *)a, w[0]);
+    _mm256_storeu_si256((__m256i *)b, w[1]);
+    _mm256_storeu_si256((__m256i *)c, w[2]);
+    _mm256_storeu_si256((__m256i *)d, w[3]);
+
+    w[0] = _mm256_or_si256(h[8], _mm256_slli_epi64(h[9], 26));
+    a[4] = (uint64_t)_mm256_extract_epi64(w[0], 0);
+    b[4] = (uint64_t)_mm256_extract_epi64(w[0], 1);
+    c[4] = (uint64_t)_mm256_extract_epi64(w[0], 2);
+    d[4] = (uint64_t)_mm256_extract_epi64(w[0], 3);
+}
+
+# define FE4_LOAD(h, p, field) fe4_load(h, p[0].field, p[1].field, p[2].field, p[3].field)
+# define FE4_STORE(p, field, h) fe4_store(p[0].field, p[1].field, p[2].field, p[3].field, h)
+
+/* r[0..3] = p1p1 (X, Y, Z, T), as in ge_p1p1_to_p3 */
+GE_AVX2_FN void ge4_p1p1_store(ge_p3 *r, const fe4 X, const fe4 Y, const fe4 Z,
+                               const fe4 T)
+{
+    fe4 t;
+
+    fe4_mul(t, X, T);
+    FE4_STORE(r, X, t);
+    fe4_mul(t, Z, T);
+    FE4_STORE(r, Z, t);
+    fe4_mul(t, X, Y);
+    FE4_STORE(r, T, t);
+    fe4_mul(t, Y, Z);
+    FE4_STORE(r, Y, t);
+}
+
+/* r[0..3] = p[0..3] + q[0..3] (or - if negate), as in ge_add/ge_sub */
+GE_AVX2_FN void ge4_add(ge_p3 *r, const ge_p3 *p, const ge_cached *q, bool negate)
+{
+    fe4 a, b, X, Y, Z, T, t0;
+
+    FE4_LOAD(a, p, Y);
+    FE4_LOAD(b, p, X);
+    fe4_add(X, a, b);
+    fe4_sub(Y, a, b);
+    FE4_LOAD(a, q, YplusX);
+    FE4_LOAD(b, q, YminusX);
+    fe4_mul(Z, X, negate ? b : a);
+    fe4_mul(Y, Y, negate ? a : b);
+    FE4_LOAD(a, q, T2d);
+    FE4_LOAD(b, p, T);
+    fe4_mul(T, a, b);
+    FE4_LOAD(a, p, Z);
+    FE4_LOAD(b, q, Z);
+    fe4_mul(X, a, b);
+    fe4_add(t0, X, X);
+    fe4_sub(X, Z, Y);
+    fe4_add(Y, Z, Y);
+    if (negate) {
+        fe4_sub(Z, t0, T);
+        fe4_add(T, t0, T);
+    } else {
+        fe4_add(Z, t0, T);
+        fe4_sub(T, t0, T);
+    }
+    ge4_p1p1_store(r, X, Y, Z, T);
+}
+
+/* r[0..3] = p[0..3] + q[0..3] (or - if negate), as in ge_madd/ge_msub */
+GE_AVX2_FN void ge4_madd(ge_p3 *r, const ge_p3 *p, const ge_precomp *q, bool negate)
+{
+    fe4 a, b, X, Y, Z, T, t0;
+
+    FE4_LOAD(a, p, Y);
+    FE4_LOAD(b, p, X);
+    fe4_add(X, a, b);
+    fe4_sub(Y, a, b);
+    FE4_LOAD(a, q, yplusx);
+    FE4_LOAD(b, q, yminusx);
+    fe4_mul(Z, X, negate ? b : a);
+    fe4_mul(Y, Y, negate ? a : b);
+    FE4_LOAD(a, q, xy2d);
+    FE4_LOAD(b, p, T);
+    fe4_mul(T, a, b);
+    FE4_LOAD(a, p, Z);
+    fe4_add(t0, a, a);
+    fe4_sub(X, Z, Y);
+    fe4_add(Y, Z, Y);
+    if (negate) {
+        fe4_sub(Z, t0, T);
+        fe4_add(T, t0, T);
+    } else {
+        fe4_add(Z, t0, T);
+        fe4_sub(T, t0, T);
+    }
+    ge4_p1p1_store(r, X, Y, Z, T);
+}
+
+/* r[0..3] = 2 * p[0..3], as in ge_p2_dbl */
+GE_AVX2_FN void ge4_dbl(ge_p3 *r, const ge_p3 *p)
+{
+    fe4 a, b, X, Y, Z, T, t0;
+
+    FE4_LOAD(a, p, X);
+    FE4_LOAD(b, p, Y);
+    fe4_sq(X, a);
+    fe4_sq(Z, b);
+    fe4_add(Y, a, b);
+    FE4_LOAD(a, p, Z);
+    fe4_sq(T, a);
+    fe4_add(T, T, T);
+    fe4_sq(t0, Y);
+    fe4_add(Y, Z, X);
+    fe4_sub(Z, Z, X);
+    fe4_sub(X, t0, Y);
+    fe4_sub(T, T, Z);
+    ge4_p1p1_store(r, X, Y, Z, T);
+}
+
+# undef FE4_LOAD
+# undef FE4_STORE
+#endif
+
+#if defined(GE_BASE_2_51) && defined(__GNUC__) && !defined(GE_NO_IFMA) \
+    && (defined(__x86_64) || defined(__x86_64__))
+# define GE_BATCH_IFMA
+
+# include <immintrin.h>
+
+# define GE_IFMA_FN static inline __attribute__((target("avx512f,avx512ifma")))
+
+/* GCC 12 flags the undefined pass-through vector of the AVX-512 intrinsics */
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Wuninitialized"
+# pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+static bool ge_ifma_eligible()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma");
+}
+
+static const bool ge_ifma = ge_ifma_eligible();
+
+/*
+ * Limb i of eight field elements in base 2^51. Limbs are kept below
+ * 2^51 + 2^15 outside of the arithmetic, within the 52 bits that
+ * vpmadd52luq/vpmadd52huq read. The high half of a 52x52-bit product is
+ * taken at bit 52, one bit past the next limb, so it is added twice.
+ */
+typedef __m512i fe8[5];
+
+# define FE8_MASK51 _mm512_set1_epi64(0x7ffffffffffff)
+
+/* 19 * c, c too large for vpmadd52luq */
+GE_IFMA_FN __m512i fe8_times19(__m512i c)
+{
+    return _mm512_add_epi64(c, _mm512_add_epi64(_mm512_slli_epi64(c, 1),
+                                                _mm512_slli_epi64(c, 4)));
+}
+
+/* One carry from every limb to the next at once, limbs below 2^63 */
+GE_IFMA_FN void fe8_reduce(fe8 h)
+{
+    __m512i c[5];
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        c[i] = _mm512_srli_epi64(h[i], 51);
+        h[i] = _mm512_and_si512(h[i], FE8_MASK51);
+    }
+    h[0] = _mm512_add_epi64(h[0], fe8_times19(c[4]));
+    for (i = 1; i < 5; i++)
+        h[i] = _mm512_add_epi64(h[i], c[i - 1]);
+}
+
+GE_IFMA_FN void fe8_add(fe8 h, const fe8 f, const fe8 g)
+{
+    int i;
+
+    for (i = 0; i < 5; i++)
+        h[i] = _mm512_add_epi64(f[i], g[i]);
+    fe8_reduce(h);
+}
+
+/* h = f + 2p - g, as g < 2p limb by limb */
+GE_IFMA_FN void fe8_sub(fe8 h, const fe8 f, const fe8 g)
+{
+    int i;
+
+    h[0] = _mm512_sub_epi64(_mm512_add_epi64(f[0], _mm512_set1_epi64(0xfffffffffffda)), g[0]);
+    for (i = 1; i < 5; i++)
+        h[i] = _mm512_sub_epi64(_mm512_add_epi64(f[i], _mm512_set1_epi64(0xffffffffffffe)), g[i]);
+    fe8_reduce(h);
+}
+
+/* h = lo + 2 hi, limbs 5..9 folded in times 19; each limb is below 2^56 */
+GE_IFMA_FN void fe8_mul_reduce(fe8 h, __m512i lo[10], __m512i hi[10])
+{
+    __m512i z[10];
+    int i;
+
+    z[0] = lo[0];
+    for (i = 1; i < 10; i++)
+        z[i] = _mm512_add_epi64(lo[i], _mm512_add_epi64(hi[i], hi[i]));
+    for (i = 0; i < 5; i++)
+        h[i] = _mm512_add_epi64(z[i], fe8_times19(z[i + 5]));
+    fe8_reduce(h);
+}
+
+GE_IFMA_FN void fe8_mul(fe8 h, const fe8 f, const fe8 g)
+{
+    __m512i lo[10], hi[10];
+    int i, j;
+
+    for (i = 0; i < 10; i++) {
+        lo[i] = _mm512_setzero_si512();
+        hi[i] = _mm512_setzero_si512();
+    }
+
+#pragma GCC unroll 5
+    for (i = 0; i < 5; i++) {
+#pragma GCC unroll 5
+        for (j = 0; j < 5; j++) {
+            lo[i + j] = _mm512_madd52lo_epu64(lo[i + j], f[i], g[j]);
+            hi[i + j + 1] = _mm512_madd52hi_epu64(hi[i + j + 1], f[i], g[j]);
+        }
+    }
+
+    fe8_mul_reduce(h, lo, hi);
+}
+
+/*
+ * h = f * f. Doubling a limb would take it past 52 bits, so the products
+ * f[i] f[j], i < j, are summed once and their sums doubled instead.
+ */
+GE_IFMA_FN void fe8_sq(fe8 h, const fe8 f)
+{
+    __m512i lo[10], hi[10], dlo[10], dhi[10];
+    int i, j;
+
+    for (i = 0; i < 10; i++) {
+        lo[i] = _mm512_setzero_si512();
+        hi[i] = _mm512_setzero_si512();
+        dlo[i] = _mm512_setzero_si512();
+        dhi[i] = _mm512_setzero_si512();
+    }
+
+#pragma GCC unroll 5
+    for (i = 0; i < 5; i++) {
+        dlo[2 * i] = _mm512_madd52lo_epu64(dlo[2 * i], f[i], f[i]);
+        dhi[2 * i + 1] = _mm512_madd52hi_epu64(dhi[2 * i + 1], f[i], f[i]);
+#pragma GCC unroll 5
+        for (j = i + 1; j < 5; j++) {
+            lo[i + j] = _mm512_madd52lo_epu64(lo[i + j], f[i], f[j]);
+            hi[i + j + 1] = _mm512_madd52hi_epu64(hi[i + j + 1], f[i], f[j]);
+        }
+    }
+    for (i = 0; i < 10; i++) {
+        lo[i] = _mm512_add_epi64(dlo[i], _mm512_add_epi64(lo[i], lo[i]));
+        hi[i] = _mm512_add_epi64(dhi[i], _mm512_add_epi64(hi[i], hi[i]));
+    }
+
+    fe8_mul_reduce(h, lo, hi);
+}
+
+/* Byte offsets of the eight elements, stride bytes apart */
+GE_IFMA_FN __m512i fe8_offsets(size_t stride)
+{
+    return _mm512_set_epi64(7 * stride, 6 * stride, 5 * stride, 4 * stride,
+                            3 * stride, 2 * stride, stride, 0);
+}
+
+/*
+ * h = the eight elements at a, a + stride bytes, ..., of the backend
+ * chosen by ge_tables_init.
+ */
+GE_IFMA_FN void fe8_load(fe8 h, const uint64_t *a, size_t stride)
+{
+    const __m512i offsets = fe8_offsets(stride);
+    int i;
+
+# if defined(GE_BASE_2_64)
+    if (ge_fe64) {
+        __m512i w[4];
+
+        for (i = 0; i < 4; i++)
+            w[i] = _mm512_i64gather_epi64(offsets, (const void *)(a + i), 1);
+        h[0] = _mm512_and_si512(w[0], FE8_MASK51);
+        h[1] = _mm512_and_si512(_mm512_or_si512(_mm512_srli_epi64(w[0], 51),
+                                                _mm512_slli_epi64(w[1], 13)), FE8_MASK51);
+        h[2] = _mm512_and_si512(_mm512_or_si512(_mm512_srli_epi64(w[1], 38),
+                                                _mm512_slli_epi64(w[2], 26)), FE8_MASK51);
+        h[3] = _mm512_and_si512(_mm512_or_si512(_mm512_srli_epi64(w[2], 25),
+                                                _mm512_slli_epi64(w[3], 39)), FE8_MASK51);
+        h[4] = _mm512_and_si512(_mm512_srli_epi64(w[3], 12), FE8_MASK51);
+        /* bit 255, 2^255 = 19 */
+        h[0] = _mm512_add_epi64(h[0], fe8_times19(_mm512_srli_epi64(w[3], 63)));
+        return;
+    }
+# endif
+
+    /* fe51 limbs may exceed 52 bits (up to about 2^54) after additions; reduce before IFMA */
+    for (i = 0; i < 5; i++)
+        h[i] = _mm512_i64gather_epi64(offsets, (const void *)(a + i), 1);
+    fe8_reduce(h);
+}
+
+/*
+ * Store f at a, a + stride bytes, ... Carries through limbs 0..3 leave
+ * limb 4 below 2^52, which both 64-bit limb backends absorb.
+ */
+GE_IFMA_FN void fe8_store(uint64_t *a, size_t stride, const fe8 f)
+{
+    const __m512i offsets = fe8_offsets(stride);
+    fe8 h;
+    __m512i carry;
+    int i;
+
+    for (i = 0; i < 5; i++)
+        h[i] = f[i];
+    for (i = 0; i < 4; i++) {
+        carry = _mm512_srli_epi64(h[i], 51);
+        h[i] = _mm512_and_si512(h[i], FE8_MASK51);
+        h[i + 1] = _mm512_add_epi64(h[i + 1], carry);
+    }
+
+# if defined(GE_BASE_2_64)
+    if (ge_fe64) {
+        __m512i w[4];
+
+        w[0] = _mm512_or_si512(h[0], _mm512_slli_epi64(h[1], 51));
+        w[1] = _mm512_or_si512(_mm512_srli_epi64(h[1], 13), _mm512_slli_epi64(h[2], 38));
+        w[2] = _mm512_or_si512(_mm512_srli_epi64(h[2], 26), _mm512_slli_epi64(h[3], 25));
+        w[3] = _mm512_or_si512(_mm512_srli_epi64(h[3], 39), _mm512_slli_epi64(h[4], 12));
+        for (i = 0; i < 4; i++)
+            _mm512_i64scatter_epi64((void *)(a + i), offsets, w[i], 1);
+        return;
+    }
+# endif
+
+    for (i = 0; i < 5; i++)
+        _mm512_i64scatter_epi64((void *)(a + i), offsets, h[i], 1);
+}
+
+# define FE8_LOAD(h, p, field) fe8_load(h, p[0].field, sizeof(p[0]))
+# define FE8_STORE(p, field, h) fe8_store(p[0].field, sizeof(p[0]), h)
+
+/* r[0..7] = p1p1 (X, Y, Z, T), as in ge_p1p1_to_p3 */
+GE_IFMA_FN void ge8_p1p1_store(ge_p3 *r, const fe8 X, const fe8 Y, const fe8 Z,
+                               const fe8 T)
+{
+    fe8 t;
+
+    fe8_mul(t, X, T);
+    FE8_STORE(r, X, t);
+    fe8_mul(t, Z, T);
+    FE8_STORE(r, Z, t);
+    fe8_mul(t, X, Y);
+    FE8_STORE(r, T, t);
+    fe8_mul(t, Y, Z);
+    FE8_STORE(r, Y, t);
+}
+
+/* r[0..7] = p[0..7] + q[0..7] (or - if negate), as in ge_add/ge_sub */
+GE_IFMA_FN void ge8_add(ge_p3 *r, const ge_p3 *p, const ge_cached *q, bool negate)
+{
+    fe8 a, b, X, Y, Z, T, t0;
+
+    FE8_LOAD(a, p, Y);
+    FE8_LOAD(b, p, X);
+    fe8_add(X, a, b);
+    fe8_sub(Y, a, b);
+    FE8_LOAD(a, q, YplusX);
+    FE8_LOAD(b, q, YminusX);
+    fe8_mul(Z, X, negate ? b : a);
+    fe8_mul(Y, Y, negate ? a : b);
+    FE8_LOAD(a, q, T2d);
+    FE8_LOAD(b, p, T);
+    fe8_mul(T, a, b);
+    FE8_LOAD(a, p, Z);
+    FE8_LOAD(b, q, Z);
+    fe8_mul(X, a, b);
+    fe8_add(t0, X, X);
+    fe8_sub(X, Z, Y);
+    fe8_add(Y, Z, Y);
+    if (negate) {
+        fe8_sub(Z, t0, T);
+        fe8_add(T, t0, T);
+    } else {
+        fe8_add(Z, t0, T);
+        fe8_sub(T, t0, T);
+    }
+    ge8_p1p1_store(r, X, Y, Z, T);
+}
+
+/* r[0..7] = p[0..7] + q[0..7] (or - if negate), as in ge_madd/ge_msub */
+GE_IFMA_FN void ge8_madd(ge_p3 *r, const ge_p3 *p, const ge_precomp *q, bool negate)
+{
+    fe8 a, b, X, Y, Z, T, t0;
+
+    FE8_LOAD(a, p, Y);
+    FE8_LOAD(b, p, X);
+    fe8_add(X, a, b);
+    fe8_sub(Y, a, b);
+    FE8_LOAD(a, q, yplusx);
+    FE8_LOAD(b, q, yminusx);
+    fe8_mul(Z, X, negate ? b : a);
+    fe8_mul(Y, Y, negate ? a : b);
+    FE8_LOAD(a, q, xy2d);
+    FE8_LOAD(b, p, T);
+    fe8_mul(T, a, b);
+    FE8_LOAD(a, p, Z);
+    fe8_add(t0, a, a);
+    fe8_sub(X, Z, Y);
+    fe8_add(Y, Z, Y);
+    if (negate) {
+        fe8_sub(Z, t0, T);
+        fe8_add(T, t0, T);
+    } else {
+        fe8_add(Z, t0, T);
+        fe8_sub(T, t0, T);
+    }
+    ge8_p1p1_store(r, X, Y, Z, T);
+}
+
+/* r[0..7] = 2 * p[0..7], as in ge_p2_dbl */
+GE_IFMA_FN void ge8_dbl(ge_p3 *r, const ge_p3 *p)
+{
+    fe8 a, b, X, Y, Z, T, t0;
+
+    FE8_LOAD(a, p, X);
+    FE8_LOAD(b, p, Y);
+    fe8_sq(X, a);
+    fe8_sq(Z, b);
+    fe8_add(Y, a, b);
+    FE8_LOAD(a, p, Z);
+    fe8_sq(T, a);
+    fe8_add(T, T, T);
+    fe8_sq(t0, Y);
+    fe8_add(Y, Z, X);
+    fe8_sub(Z, Z, X);
+    fe8_sub(X, t0, Y);
+    fe8_sub(T, T, Z);
+    ge8_p1p1_store(r, X, Y, Z, T);
+}
+
+# undef FE8_LOAD
+# undef FE8_STORE
+
+# pragma GCC diagnostic pop
+#endif
+
+/* r[i] = p[i] + q[i] */
+static inline void ge_add_batch(ge_p3 *r, const ge_p3 *p, const ge_cached *q, size_t n)
+{
+    ge_p1p1 t;
+    size_t i = 0;
+
+#if defined(GE_BATCH_IFMA)
+    if (ge_ifma) {
+        for (; i + 8 <= n; i += 8)
+            ge8_add(r + i, p + i, q + i, false);
+    }
+#endif
+#if defined(GE_BATCH_AVX2)
+    if (ge_avx2) {
+        for (; i + 4 <= n; i += 4)
+            ge4_add(r + i, p + i, q + i, false);
+    }
+#endif
+    for (; i < n; i++) {
+        ge_add(&t, &p[i], &q[i]);
+        ge_p1p1_to_p3(&r[i], &t);
+    }
+}
+
+/* r[i] = p[i] - q[i] */
+static inline void ge_sub_batch(ge_p3 *r, const ge_p3 *p, const ge_cached *q, size_t n)
+{
+    ge_p1p1 t;
+    size_t i = 0;
+
+#if defined(GE_BATCH_IFMA)
+    if (ge_ifma) {
+        for (; i + 8 <= n; i += 8)
+            ge8_add(r + i, p + i, q + i, true);
+    }
+#endif
+#if defined(GE_BATCH_AVX2)
+    if (ge_avx2) {
+        for (; i + 4 <= n; i += 4)
+            ge4_add(r + i, p + i, q + i, true);
+    }
+#endif
+    for (; i < n; i++) {
+        ge_sub(&t, &p[i], &q[i]);
+        ge_p1p1_to_p3(&r[i], &t);
+    }
+}
+
+/* r[i] = p[i] + q[i] */
+static inline void ge_madd_batch(ge_p3 *r, const ge_p3 *p, const ge_precomp *q, size_t n)
+{
+    ge_p1p1 t;
+    size_t i = 0;
+
+#if defined(GE_BATCH_IFMA)
+    if (ge_ifma) {
+        for (; i + 8 <= n; i += 8)
+            ge8_madd(r + i, p + i, q + i, false);
+    }
+#endif
+#if defined(GE_BATCH_AVX2)
+    if (ge_avx2) {
+        for (; i + 4 <= n; i += 4)
+            ge4_madd(r + i, p + i, q + i, false);
+    }
+#endif
+    for (; i < n; i++) {
+        ge_madd(&t, &p[i], &q[i]);
+        ge_p1p1_to_p3(&r[i], &t);
+    }
+}
+
+/* r[i] = p[i] - q[i] */
+static inline void ge_msub_batch(ge_p3 *r, const ge_p3 *p, const ge_precomp *q, size_t n)
+{
+    ge_p1p1 t;
+    size_t i = 0;
+
+#if defined(GE_BATCH_IFMA)
+    if (ge_ifma) {
+        for (; i + 8 <= n; i += 8)
+            ge8_madd(r + i, p + i, q + i, true);
+    }
+#endif
+#if defined(GE_BATCH_AVX2)
+    if (ge_avx2) {
+        for (; i + 4 <= n; i += 4)
+            ge4_madd(r + i, p + i, q + i, true);
+    }
+#endif
+    for (; i < n; i++) {
+        ge_msub(&t, &p[i], &q[i]);
+        ge_p1p1_to_p3(&r[i], &t);
+    }
+}
+
+/* r[i] = 2 * p[i] */
+static inline void ge_dbl_batch(ge_p3 *r, const ge_p3 *p, size_t n)
+{
+    ge_p1p1 t;
+    size_t i = 0;
+
+#if defined(GE_BATCH_IFMA)
+    if (ge_ifma) {
+        for (; i + 8 <= n; i += 8)
+            ge8_dbl(r + i, p + i);
+    }
+#endif
+#if defined(GE_BATCH_AVX2)
+    if (ge_avx2) {
+        for (; i + 4 <= n; i += 4)
+            ge4_dbl(r + i, p + i);
+    }
+#endif
+    for (; i < n; i++) {
+        ge_p3_dbl(&t, &p[i]);
+        ge_p1p1_to_p3(&r[i], &t);
+    }
+}
+
+#endif // GE_BATCH_H
@@ -0,0 +1,552 @@
+/*
+ * Copyright 2019 Zhicong Huang (zhicong303@gmail.com). All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution.
+ */
+
+#ifndef KANGAROO_H
+#define KANGAROO_H
+
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+#include <stdexcept>
+#include "curve25519.h"
+#include "random_source.h"
+
+/* "LHEKANGA" in little-endian */
+#define KANGAROO_MAGIC 0x41474e414b45484cULL
+#define KANGAROO_VERSION 1
+
+/* Number of distinct jumps of the pseudo-random walk (a power of 2) */
+#define KANGAROO_JUMPS 64
+
+/* Wild kangaroos walking in parallel when solving a single point */
+#define KANGAROO_WALKERS 8
+
+/* Tame kangaroos walking in parallel per thread during precomputation */
+#define KANGAROO_BATCH 128
+
+/* Walks generated during precomputation per table entry kept */
+#define KANGAROO_OVERSAMPLE 2
+
+/* Seed of the jump sizes and tame starting points, so tables are reproducible */
+#define KANGAROO_SEED 0x4c48453235353139ULL
+
+struct KangarooEntry {
+    uint64_t fingerprint;
+    uint64_t log;
+};
+
+struct KangarooHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t msg_bits;
+    uint32_t dp_bits;
+    uint32_t reserved;
+    uint64_t seed;
+    uint64_t num_entries;
+};
+
+/*
+ * Discrete logarithms in an interval with Pollard's kangaroo method and a
+ * precomputed table of distinguished points, following Bernstein and
+ * Lange, "Computing small discrete logarithms faster" (2012).
+ *
+ * Let W = 2^{msg_bits} and T the number of table entries. A message m in
+ * [-W/2, W/2) is shifted to x = m + W/2 in [0, W). A walk moves from point
+ * P to P + s_j*G, where j is taken from the compressed encoding of P and
+ * s_1, ..., s_64 are fixed random jump sizes with mean W*theta/4. A point
+ * is distinguished when 'dp_bits' bits of its encoding are zero, i.e. with
+ * probability theta = 2^{-dp_bits} ~ sqrt(T/W).
+ *
+ * Precomputation runs KANGAROO_OVERSAMPLE*T "tame" walks from known
+ * multiples of G until they hit a distinguished point, and keeps the T
+ * points reached most often together with their logarithms. To solve, a
+ * "wild" walk starts from the unknown point plus a known random offset.
+ * Once it crosses any tame trail it follows it to a stored point, which
+ * reveals x. Walks that end at an unknown distinguished point restart from
+ * a new offset.
+ *
+ * This takes about 2*sqrt(W/T) steps, so with T ~ W^{1/3} the time and the
+ * table (16 bytes per entry) both grow as the cube root of W: for 40-bit
+ * messages and T = 2^16 a decryption takes about 8000 steps from a 1 MB
+ * table, where baby-step-giant-step needs 2^15 steps from a 300 MB table.
+ * Messages of up to 62 bits can be handled.
+ */
+class KangarooTable {
+
+public:
+    KangarooTable() {}
+
+    /*
+     * Build a table with num_entries distinguished points for messages of
+     * msg_bits bits (sign included), using num_threads threads (0 uses all
+     * hardware threads). The result does not depend on num_threads.
+     */
+    void build(int msg_bits, size_t num_entries, unsigned num_threads = 0) {
+        if (msg_bits < 8 || msg_bits > 62)
+            throw std::invalid_argument("Kangaroo message bits must be in [8, 62]");
+        if (num_entries < 1 || num_entries > (1ULL << (msg_bits - 4)))
+            throw std::invalid_argument("Kangaroo table size must be in [1, 2^{msg_bits-4}]");
+        if (num_threads == 0)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        int dp_bits = (int)std::lround((msg_bits - std::log2((double)num_entries)) / 2);
+        setup(msg_bits, std::max(dp_bits, 0), KANGAROO_SEED);
+
+        // Tame walks start at x*G for random x in [0, W)
+        size_t num_walks = KANGAROO_OVERSAMPLE * num_entries;
+        std::vector<uint64_t> starts(num_walks);
+        std::mt19937_64 rng(seed_ + 1);
+        for (size_t i = 0; i < num_walks; i++)
+            starts[i] = rng() & (width() - 1);
+
+        std::vector<KangarooEntry> ends(num_walks);
+        size_t slice = (num_walks + num_threads - 1) / num_threads;
+        std::vector<std::thread> workers;
+        for (size_t begin = 0; begin < num_walks; begin += slice) {
+            size_t count = std::min(slice, num_walks - begin);
+            workers.emplace_back(&KangarooTable::tame_walks, this,
+                &starts[begin], &ends[begin], count);
+        }
+        for (size_t t = 0; t < workers.size(); t++)
+            workers[t].join();
+
+        select_entries(ends, num_entries);
+    }
+
+    int msg_bits() const {
+        return msg_bits_;
+    }
+
+    bool empty() const {
+        return entries_.empty();
+    }
+
+    size_t size() const {
+        return entries_.size();
+    }
+
+    /*
+     * Find m in [-2^{msg_bits-1}, 2^{msg_bits-1}) with points[t] = m*G for
+     * each of the count points, writing it to values[t] and setting
+     * solved[t]. Each point is searched by walkers_per_point wild walks at
+     * a time, and all walks of all points share one field inversion per
+     * step. Gives up on a point after a bounded number of walks (which
+     * almost only happens when its logarithm is out of range), and on all
+     * of them once *stop is set. Walks start from offsets drawn afresh on
+     * every call (see random_bytes), so a point that was given up on in
+     * range gets other walks when solved again; stream is mixed into them
+     * to keep concurrent searches apart under a seeded source.
+     */
+    void solve(int64_t* values, bool* solved, const ge_p3* points, size_t count,
+               int walkers_per_point, const std::atomic<bool>* stop = nullptr,
+               uint64_t stream = 0) const {
+        if (entries_.empty())
+            throw std::logic_error("Kangaroo table is empty");
+
+        // targets[t] = points[t] + (W/2)*G = (m + W/2)*G
+        std::vector<ge_p3> targets(count);
+        std::vector<uint8_t> target_keys(32 * count);
+        std::unique_ptr<gfe[]> scratch(new gfe[2 * std::max<size_t>(count, 1)]);
+        ge_p1p1 t;
+        for (size_t i = 0; i < count; i++) {
+            ge_add(&t, &points[i], &half_);
+            ge_p1p1_to_p3(&targets[i], &t);
+            solved[i] = false;
+        }
+        ge_p3_batch_tobytes(target_keys.data(), targets.data(), scratch.get(), count);
+
+        uint64_t seed;
+        random_bytes(&seed, sizeof(seed));
+        std::mt19937_64 rng(seed + stream);
+        std::vector<int> walks_left(count, 64 * walkers_per_point);
+        std::vector<int> walking(count, 0);
+
+        Walkers wild;
+        for (size_t i = 0; i < count; i++) {
+            for (int w = 0; w < walkers_per_point; w++) {
+                wild.push_back(i);
+                restart_wild(wild, wild.size() - 1, targets[i], rng);
+                walks_left[i]--;
+                walking[i]++;
+            }
+        }
+
+        uint64_t max_steps = 16ULL << dp_bits_;
+        std::vector<uint8_t> keys(32 * wild.size());
+        scratch.reset(new gfe[2 * std::max<size_t>(wild.size(), 1)]);
+        std::vector<char> retire(wild.size());
+
+        while (wild.size() > 0) {
+            if (stop != nullptr && stop->load(std::memory_order_relaxed))
+                return;
+
+            size_t n = wild.size();
+            ge_p3_batch_tobytes(keys.data(), wild.points.data(), scratch.get(), n);
+
+            for (size_t w = 0; w < n; w++) {
+                const uint8_t* key = &keys[32 * w];
+                size_t owner = wild.owners[w];
+                retire[w] = 0;
+                if (solved[owner]) {
+                    retire[w] = 1;
+                    continue;
+                }
+
+                if (is_distinguished(key)) {
+                    uint64_t x;
+                    if (lookup(key, wild.distances[w], &target_keys[32 * owner], x)) {
+                        values[owner] = (int64_t)x - (int64_t)(width() / 2);
+                        solved[owner] = true;
+                        retire[w] = 1;
+                        continue;
+                    }
+                } else if (++wild.steps[w] <= max_steps) {
+                    jump(wild, w, key);
+                    continue;
+                }
+
+                // Missed the table (or walked in a cycle): start over
+                if (walks_left[owner] > 0) {
+                    walks_left[owner]--;
+                    restart_wild(wild, w, targets[owner], rng);
+                } else {
+                    retire[w] = 1;
+                }
+            }
+            wild.compact(retire);
+        }
+    }
+
+    void save(std::ostream& stream) const {
+        KangarooHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = KANGAROO_MAGIC;
+        header.version = KANGAROO_VERSION;
+        header.msg_bits = msg_bits_;
+        header.dp_bits = dp_bits_;
+        header.seed = seed_;
+        header.num_entries = entries_.size();
+
+        stream.write((const char*)&header, sizeof(header));
+        stream.write((const char*)entries_.data(), entries_.size() * sizeof(KangarooEntry));
+    }
+
+    void load(std::istream& stream) {
+        KangarooHeader header;
+        stream.read((char*)&header, sizeof(header));
+        if (!stream || header.magic != KANGAROO_MAGIC)
+            throw std::runtime_error("Not a kangaroo table file");
+        if (header.version != KANGAROO_VERSION)
+            throw std::runtime_error("Unsupported kangaroo table version");
+        if (header.msg_bits < 8 || header.msg_bits > 62 || header.dp_bits > header.msg_bits)
+            throw std::runtime_error("Corrupted kangaroo table header");
+
+        if (header.num_entries < 1 || header.num_entries > (1ULL << (header.msg_bits - 4)))
+            throw std::runtime_error("Corrupted kangaroo table header");
+
+        // Do not allocate for entries that a seekable stream does not hold
+        std::streampos start = stream.tellg();
+        if (start != std::streampos(-1)) {
+            stream.seekg(0, std::ios::end);
+            std::streamoff available = stream.tellg() - start;
+            stream.seekg(start);
+            if (available < (std::streamoff)(header.num_entries * sizeof(KangarooEntry)))
+                throw std::runtime_error("Kangaroo table file is truncated");
+        }
+
+        std::vector<KangarooEntry> entries(header.num_entries);
+        stream.read((char*)entries.data(), entries.size() * sizeof(KangarooEntry));
+        if (!stream)
+            throw std::runtime_error("Kangaroo table file is truncated");
+
+        // lookup binary-searches the entries by fingerprint
+        if (!std::is_sorted(entries.begin(), entries.end(),
+                [](const KangarooEntry& a, const KangarooEntry& b) {
+                    return a.fingerprint < b.fingerprint;
+                }))
+            throw std::runtime_error("Corrupted kangaroo table entries");
+
+        setup(header.msg_bits, header.dp_bits, header.seed);
+        entries_.swap(entries);
+    }
+
+private:
+    /* Structure of arrays, so that the points can be normalized in one batch */
+    struct Walkers {
+        std::vector<ge_p3> points;
+        std::vector<uint64_t> distances;
+        std::vector<uint64_t> steps;
+        std::vector<size_t> owners;
+
+        size_t size() const {
+            return points.size();
+        }
+
+        void push_back(size_t owner) {
+            points.push_back(ge_p3());
+            distances.push_back(0);
+            steps.push_back(0);
+            owners.push_back(owner);
+        }
+
+        /* Remove the walkers flagged in retire, keeping the others in order */
+        void compact(const std::vector<char>& retire) {
+            size_t kept = 0;
+            for (size_t w = 0; w < size(); w++) {
+                if (retire[w])
+                    continue;
+                points[kept] = points[w];
+                distances[kept] = distances[w];
+                steps[kept] = steps[w];
+                owners[kept] = owners[w];
+                kept++;
+            }
+            points.resize(kept);
+            distances.resize(kept);
+            steps.resize(kept);
+            owners.resize(kept);
+        }
+    };
+
+    uint64_t width() const {
+        return 1ULL << msg_bits_;
+    }
+
+    static uint32_t load_le32(const uint8_t* in) {
+        return ((uint32_t)in[0]) | ((uint32_t)in[1] << 8) |
+               ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+    }
+
+    static uint64_t load_le64(const uint8_t* in) {
+        return ((uint64_t)load_le32(in + 4) << 32) | load_le32(in);
+    }
+
+    static void scalar_from_u64(uint8_t s[32], uint64_t v) {
+        memset(s, 0, 32);
+        for (int i = 0; i < 8; i++)
+            s[i] = (v >> (8 * i)) & 0xFF;
+    }
+
+    /*
+     * The fingerprint, the distinguished-point test and the jump index use
+     * disjoint bytes of the encoding, so they are independent.
+     */
+    bool is_distinguished(const uint8_t key[32]) const {
+        return (load_le32(key + 12) & dp_mask_) == 0;
+    }
+
+    void jump(Walkers& walkers, size_t w, const uint8_t key[32]) const {
+        int j = key[16] & (KANGAROO_JUMPS - 1);
+        ge_p1p1 t;
+        ge_madd(&t, &walkers.points[w], &jumps_[j]);
+        ge_p1p1_to_p3(&walkers.points[w], &t);
+        walkers.distances[w] += jump_sizes_[j];
+    }
+
+    /* Derive the walk from the parameters; entries are left untouched */
+    void setup(int msg_bits, int dp_bits, uint64_t seed) {
+        msg_bits_ = msg_bits;
+        dp_bits_ = dp_bits;
+        dp_mask_ = dp_bits >= 32 ? 0xFFFFFFFFu : (uint32_t)((1ULL << dp_bits) - 1);
+        seed_ = seed;
+
+        // Mean jump W*theta/4: a walk covers about a quarter of the interval
+        int mean_bits = std::max(msg_bits - dp_bits - 2, 0);
+        uint64_t mean = 1ULL << mean_bits;
+
+        std::mt19937_64 rng(seed);
+        uint8_t scalar[32];
+        ge_p3 point;
+        jumps_.resize(KANGAROO_JUMPS);
+        jump_sizes_.resize(KANGAROO_JUMPS);
+        for (int j = 0; j < KANGAROO_JUMPS; j++) {
+            jump_sizes_[j] = 1 + rng() % (2 * mean);
+            scalar_from_u64(scalar, jump_sizes_[j]);
+            ge_scalarmult_base(&point, scalar);
+            ge_p3_to_precomp(&jumps_[j], &point);
+        }
+
+        scalar_from_u64(scalar, width() / 2);
+        ge_scalarmult_base(&point, scalar);
+        ge_p3_to_cached(&half_, &point);
+    }
+
+    /* Walker w starts again from target + delta*G for a fresh random delta < W/8 */
+    void restart_wild(Walkers& wild, size_t w, const ge_p3& target, std::mt19937_64& rng) const {
+        uint64_t delta = rng() & (width() / 8 - 1);
+        uint8_t scalar[32];
+        ge_p3 offset;
+        ge_cached offset_cached;
+        ge_p1p1 t;
+
+        scalar_from_u64(scalar, delta);
+        ge_scalarmult_base(&offset, scalar);
+        ge_p3_to_cached(&offset_cached, &offset);
+        ge_add(&t, &target, &offset_cached);
+        ge_p1p1_to_p3(&wild.points[w], &t);
+        wild.distances[w] = delta;
+        wild.steps[w] = 0;
+    }
+
+    /*
+     * A wild walk with the given distance travelled reached the
+     * distinguished point key. If the table knows its logarithm, recover
+     * x and confirm that x*G is the target.
+     */
+    bool lookup(const uint8_t key[32], uint64_t distance, const uint8_t target_key[32],
+                uint64_t& x) const {
+        KangarooEntry probe = {load_le64(key), 0};
+        auto it = std::lower_bound(entries_.begin(), entries_.end(), probe,
+            [](const KangarooEntry& a, const KangarooEntry& b) {
+                return a.fingerprint < b.fingerprint;
+            });
+        for (; it != entries_.end() && it->fingerprint == probe.fingerprint; ++it) {
+            if (it->log < distance || it->log - distance >= width())
+                continue;
+
+            uint8_t scalar[32];
+            uint8_t bytes[32];
+            ge_p3 point;
+            scalar_from_u64(scalar, it->log - distance);
+            ge_scalarmult_base(&point, scalar);
+            ge_p3_tobytes(bytes, &point);
+            if (memcmp(bytes, target_key, 32) == 0) {
+                x = it->log - distance;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * Run the tame walks starting at starts[0..count), writing the
+     * distinguished point each one ends at to ends (log = UINT64_MAX for
+     * walks abandoned as cycles).
+     */
+    void tame_walks(const uint64_t* starts, KangarooEntry* ends, size_t count) const {
+        Walkers tame;
+        std::vector<size_t> ids;
+        size_t next = 0;
+        uint8_t scalar[32];
+
+        while (tame.size() < KANGAROO_BATCH && next < count) {
+            tame.push_back(0);
+            ids.push_back(next);
+            size_t w = tame.size() - 1;
+            tame.distances[w] = starts[next];
+            scalar_from_u64(scalar, starts[next]);
+            ge_scalarmult_base(&tame.points[w], scalar);
+            next++;
+        }
+
+        uint64_t max_steps = 16ULL << dp_bits_;
+        std::vector<uint8_t> keys(32 * tame.size());
+        std::unique_ptr<gfe[]> scratch(new gfe[2 * std::max<size_t>(tame.size(), 1)]);
+        std::vector<char> retire(tame.size());
+
+        while (tame.size() > 0) {
+            size_t n = tame.size();
+            ge_p3_batch_tobytes(keys.data(), tame.points.data(), scratch.get(), n);
+
+            for (size_t w = 0; w < n; w++) {
+                const uint8_t* key = &keys[32 * w];
+                retire[w] = 0;
+
+                bool done = false;
+                if (is_distinguished(key)) {
+                    ends[ids[w]].fingerprint = load_le64(key);
+                    ends[ids[w]].log = tame.distances[w];
+                    done = true;
+                } else if (++tame.steps[w] > max_steps) {
+                    ends[ids[w]].fingerprint = 0;
+                    ends[ids[w]].log = UINT64_MAX;
+                    done = true;
+                }
+
+                if (!done) {
+                    jump(tame, w, key);
+                } else if (next < count) {
+                    ids[w] = next;
+                    tame.distances[w] = starts[next];
+                    tame.steps[w] = 0;
+                    scalar_from_u64(scalar, starts[next]);
+                    ge_scalarmult_base(&tame.points[w], scalar);
+                    next++;
+                } else {
+                    retire[w] = 1;
+                }
+            }
+
+            size_t kept = 0;
+            for (size_t w = 0; w < n; w++) {
+                if (!retire[w])
+                    ids[kept++] = ids[w];
+            }
+            ids.resize(kept);
+            tame.compact(retire);
+        }
+    }
+
+    /*
+     * Keep the num_entries distinguished points reached by the most tame
+     * walks (ties broken by fingerprint), sorted by fingerprint.
+     */
+    void select_entries(std::vector<KangarooEntry>& ends, size_t num_entries) {
+        std::sort(ends.begin(), ends.end(),
+            [](const KangarooEntry& a, const KangarooEntry& b) {
+                return a.fingerprint != b.fingerprint ? a.fingerprint < b.fingerprint : a.log < b.log;
+            });
+
+        std::vector<std::pair<size_t, KangarooEntry>> counted;
+        for (size_t i = 0; i < ends.size(); ) {
+            size_t j = i;
+            while (j < ends.size() && ends[j].fingerprint == ends[i].fingerprint &&
+                   ends[j].log == ends[i].log)
+                j++;
+            if (ends[i].log != UINT64_MAX)
+                counted.push_back(std::make_pair(j - i, ends[i]));
+            i = j;
+        }
+
+        std::stable_sort(counted.begin(), counted.end(),
+            [](const std::pair<size_t, KangarooEntry>& a, const std::pair<size_t, KangarooEntry>& b) {
+                return a.first > b.first;
+            });
+        if (counted.size() > num_entries)
+            counted.resize(num_entries);
+
+        entries_.clear();
+        for (size_t i = 0; i < counted.size(); i++)
+            entries_.push_back(counted[i].second);
+        std::sort(entries_.begin(), entries_.end(),
+            [](const KangarooEntry& a, const KangarooEntry& b) {
+                return a.fingerprint < b.fingerprint;
+            });
+    }
+
+    int msg_bits_ = 0;
+    int dp_bits_ = 0;
+    uint32_t dp_mask_ = 0;
+    uint64_t seed_ = KANGAROO_SEED;
+
+    std::vector<ge_precomp> jumps_;
+    std::vector<uint64_t> jump_sizes_;
+    ge_cached half_;
+
+    std::vector<KangarooEntry> entries_;
+};
+
+#endif // KANGAROO_H
@@ -10,10 +10,21 @@
 #define LHE25519_H
 
 #include <random>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
 #include <iostream>
+#include <algorithm>
 #include <stdexcept>
-#include <unordered_map>
 #include "curve25519.h"
+#include "ge_batch.h"
+#include "decryption_table.h"
+#include "kangaroo.h"
+#include "mask_pool.h"
+#include "msm.h"
+#include "random_source.h"
+#include "table_registry.h"
 #include "test.h"
 
 struct Ciphertext {
@@ -21,6 +32,11 @@ struct Ciphertext {
     ge_p3 c1;
 };
 
+/*
+ * m is the scalar (value mod L). When m or L - m is below 2^63, hom_mul,
+ * hom_add_plain and the like multiply by that magnitude only, a few bits
+ * instead of 253 for a negative value, and negate the point afterwards.
+ */
 struct Plaintext {
     uint8_t m[32] = {0};
 };
@@ -49,6 +65,27 @@ struct PublicKey {
     }
 };
 
+/*
+ * A public key with its fixed-base table, table_[i][j] = (j+1)*256^i*PK as
+ * k25519Precomp is for the base point, so that r*PK costs no more than
+ * r*G in encrypt. Building it takes about as long as 20 encryptions, and
+ * the table takes 32*8 ge_precomp (30 KB with 64-bit limbs), so LHE25519
+ * holds it through a shared_ptr instead of copying it.
+ */
+struct PreparedPublicKey {
+    PublicKey pk_;
+    ge_precomp table_[32][8];
+
+    PreparedPublicKey() {}
+
+    explicit PreparedPublicKey(const PublicKey& pk)
+        : pk_(pk) {
+        std::vector<ge_p3> points(32 * 8);
+        std::unique_ptr<gfe[]> scratch(new gfe[2 * 32 * 8]);
+        ge_precompute_table(table_, &pk_.data_, points.data(), scratch.get());
+    }
+};
+
 struct SecretKey {
     uint8_t data_[32];
 
@@ -69,32 +106,48 @@ struct SecretKey {
     }
 };
 
-void random_bytes(void* data, size_t len) {
-    int* alias = (int *)(&data);
-    std::random_device rd;
-    for (size_t i = 0; i < len / sizeof(int); ++i)
-        alias[i] = rd();
+/*
+ * Number of candidate points normalized together (sharing one field
+ * inversion) by the decryption search and the table precomputation.
+ */
+#define SEARCH_BLOCK 128
+
+/*
+ * How many keys ahead batch decryption prefetches table buckets while
+ * probing (see LookupTable::prefetch).
+ */
+#define PROBE_PREFETCH_DISTANCE 16
 
-    if (len % sizeof(int) != 0) {
-			int extra = rd();
-			memcpy((len/sizeof(int)*sizeof(int))+(char *) data, &extra, len%sizeof(4));
-		}
-}
+/* Number of table entries computed per round of precompute_decrypt_table */
+#define PRECOMPUTE_ROUND (1 << 18)
 
-#define MSG_BITS 40
-#define BABY_BITS 15
-#define GIANT_BITS (MSG_BITS-BABY_BITS)
+/*
+ * How decrypt recovers m from m*G: baby-step-giant-step over the table
+ * built by precompute_decrypt_table, or kangaroo walks over the much
+ * smaller table built by precompute_kangaroo_table.
+ */
+enum class DecryptSolver {
+    BabyStepGiantStep,
+    Kangaroo
+};
 
 class LHE25519 {
 
 public:
     
     LHE25519(const PublicKey& pk)
-        : pk_(pk), has_sk_(false) {
+        : pk_(std::make_shared<PreparedPublicKey>(pk)), has_sk_(false) {
+    }
+
+    /* Shares a key prepared once among several instances */
+    LHE25519(std::shared_ptr<const PreparedPublicKey> pk)
+        : pk_(std::move(pk)), has_sk_(false) {
+        if (!pk_)
+            throw std::invalid_argument("Public key must not be null");
     }
 
     LHE25519(const PublicKey& pk, const SecretKey& sk)
-        : pk_(pk), sk_(sk), has_sk_(true) {
+        : pk_(std::make_shared<PreparedPublicKey>(pk)), sk_(sk), has_sk_(true) {
     }
 
     LHE25519() {
@@ -107,85 +160,137 @@ public:
         sk_.data_[31] &= 63;
         sk_.data_[31] |= 64;
 
-        ge_scalarmult_base(&pk_.data_, sk_.data_);
+        ge_p3 pk;
+        ge_scalarmult_base(&pk, sk_.data_);
+        // Masks made for the previous key are of no use
+        mask_pool_.reset();
+        pk_ = std::make_shared<PreparedPublicKey>(PublicKey(pk));
 
         has_sk_ = true;
     }
 
     /*
      * The decryption table content is fixed for curve Ed25519, 
-     * hence it only needs to be precomputed once.
+     * hence it only needs to be precomputed once for a given split
+     * (see DecryptionTable for the meaning of msg_bits and baby_bits).
+     *
+     * The giant steps are split into rounds of PRECOMPUTE_ROUND entries,
+     * and each round into one contiguous range per thread. Entries are
+     * inserted in index order once a round is done, so the table (and the
+     * file written by save_table) does not depend on num_threads.
+     * num_threads = 0 uses all hardware threads.
+     *
+     * A symmetric table only stores non-negative giant steps and is half
+     * the size (see DecryptionTable).
      */
-    void precompute_decrypt_table() {
+    void precompute_decrypt_table(int msg_bits = MSG_BITS, int baby_bits = BABY_BITS,
+                                  unsigned num_threads = 0, bool symmetric = false) {
         /* 
          * We use bay-step-giant-step to optimize the tradeoff between
          * look-up table storage and the decryption speed:
-         * For 40-bit message m, we break it as: m = m1*2^{BABY_BITS} + m0,
-         * where -2^{GIANT_BITS-1} <= m1 <= 2^{GIANT_BITS-1}-1, 0 <= m0 <= 2^{BABY_BITS}-1
-         * And we only store the giant steps in the table: m1*2^{BABY_BITS}
+         * For msg_bits-bit message m, we break it as: m = m1*2^{baby_bits} + m0,
+         * where -2^{giant_bits-1} <= m1 <= 2^{giant_bits-1}-1, 0 <= m0 <= 2^{baby_bits}-1
+         * And we only store the giant steps in the table: m1*2^{baby_bits}
          */
 
-        ge_p3 entry;
+        if (num_threads == 0)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        std::shared_ptr<DecryptionTable> table = std::make_shared<DecryptionTable>();
+        table->set_placement(placement_);
+        table->reset(msg_bits, baby_bits, symmetric);
+
         Plaintext plain;
+        ge_p3 step_p3;
+        ge_precomp step;
+
+        // 2^{baby_bits}*G, the distance between consecutive entries
+        encode(plain, 1L << baby_bits);
+        ge_scalarmult_base(&step_p3, plain.m);
+        ge_p3_to_precomp(&step, &step_p3);
+
+        int64_t first = table->min_giant_step();
+        int64_t end = table->max_giant_step() + 1;
+        std::vector<uint8_t> keys(32 * std::min<int64_t>(PRECOMPUTE_ROUND, end - first));
+        for (int64_t lo = first; lo < end; lo += PRECOMPUTE_ROUND) {
+            int64_t count = std::min<int64_t>(PRECOMPUTE_ROUND, end - lo);
+            int64_t slice = (count + num_threads - 1) / num_threads;
+
+            std::vector<std::thread> workers;
+            for (int64_t begin = 0; begin < count; begin += slice) {
+                int64_t slice_end = std::min(count, begin + slice);
+                workers.emplace_back(&LHE25519::precompute_range, this,
+                    lo + begin, slice_end - begin, baby_bits, &step, &keys[32 * begin]);
+            }
+            for (size_t t = 0; t < workers.size(); t++)
+                workers[t].join();
 
-        int n = 1L << (GIANT_BITS-1);
-        uint8_t tmp[32];
-        for (int i = -n; i < n; i++) {
-            encode(plain,  ((int64_t)i) << BABY_BITS);
-            ge_scalarmult_base(&entry, plain.m); 
-            ge_p3_tobytes(tmp, &entry);
-            table_[std::string((const char*)tmp, 32)] = i;
+            for (int64_t j = 0; j < count; j++)
+                table->lookup().insert(&keys[32 * j], (int32_t)(lo + j));
         }
+        table->place();
+        table_ = table;
     }
 
-    const PublicKey& public_key() const {
-        return pk_;
+    /*
+     * Build the table of the kangaroo solver for messages of msg_bits bits
+     * (sign included, up to 62) with num_entries distinguished points (see
+     * KangarooTable). Decryption takes about 2*sqrt(2^{msg_bits}/num_entries)
+     * steps, and precomputation about 2*sqrt(2^{msg_bits}*num_entries).
+     * The table does not depend on num_threads (0 uses all hardware threads).
+     */
+    void precompute_kangaroo_table(int msg_bits, size_t num_entries, unsigned num_threads = 0) {
+        kangaroo_.build(msg_bits, num_entries, num_threads);
     }
 
-    const SecretKey& secret_key() const {
-        return sk_;
+    /*
+     * Select the solver used by decrypt and decrypt_batch. Both solvers
+     * work on the same ciphertexts; only the table of the selected one has
+     * to be present.
+     */
+    void set_decrypt_solver(DecryptSolver solver) {
+        solver_ = solver;
     }
 
-    void encode(Plaintext& plain, int64_t value) {
-        // This library can handle at most 40-bit messages (with sign bit): [-2^39, 2^39-1]
-        int64_t upper_bound = (1L << 39) - 1;
-        int64_t lower_bound = -(1L << 39); 
-        if (value > upper_bound || value < lower_bound)
-            throw std::invalid_argument("Input value out of supported range [-2^39, 2^39-1]");
+    DecryptSolver decrypt_solver() const {
+        return solver_;
+    }
 
-        memset(plain.m, 0, sizeof(plain.m));
-        for (int i = 0; i < 8; i++) {
-            plain.m[i] = (value >> (8*i)) & 0xFFL;
-        }
+    /*
+     * Set how many baby-step candidates (and table entries during
+     * precomputation) are produced before they are normalized together
+     * with a single field inversion. A block of 1 normalizes every
+     * candidate separately.
+     */
+    void set_search_block(int block) {
+        if (block < 1)
+            throw std::invalid_argument("Search block must be positive");
+        search_block_ = block;
+    }
 
-        // Positive encodinng finishes here
-        if (value >= 0)
-            return;
+    const PublicKey& public_key() const {
+        return prepared_key().pk_;
+    }
 
-        // Next handles negative encoding 
+    /*
+     * The prepared key is immutable and shared by copies of this instance,
+     * by its mask pool and by encryptors constructed from it. nullptr until
+     * key_gen for a default-constructed instance.
+     */
+    const std::shared_ptr<const PreparedPublicKey>& prepared_public_key() const {
+        return pk_;
+    }
 
-        for (int i = 8; i < 32; i++)
-            plain.m[i] = 255;
+    const SecretKey& secret_key() const {
+        return sk_;
+    }
 
-        // Add plain with L, essentially a modulo operation
-        uint8_t carry = 0;
-        for (int i = 0; i < 32; i++) {
-            if (carry == 1 && plain.m[i] == 255) {
-                plain.m[i] += L_[i] + carry;
-                carry = 1;
-            }
-            else if ( (255 - carry - plain.m[i]) < L_[i] ) {
-                plain.m[i] += L_[i] + carry;
-                carry = 1;
-            }
-            else {
-                plain.m[i] += L_[i] + carry;
-                carry = 0;
-            }
-        }
+    void encode(Plaintext& plain, int64_t value) const {
+        check_message_range(value);
+        encode_scalar(plain, value);
     }
 
-    void decode(int64_t& value, const Plaintext& plain) {
+    void decode(int64_t& value, const Plaintext& plain) const {
         uint8_t copy[32];
         memcpy(copy, plain.m, 32);
         x25519_sc_reduce(copy); 
@@ -220,57 +325,246 @@ public:
             value |= ((int64_t)copy[i]) << (i*8);
     }
 
+    /*
+     * As a message in range is below 2^40, m*G only walks the first rows
+     * of the base point table.
+     */
     void encrypt(Ciphertext& ciphertext, int64_t value) {
-        Plaintext plain;
-        encode(plain, value);
-        encrypt(ciphertext, plain);
+        EncryptionMask mask;
+        ge_p3 mG;
+
+        check_message_range(value);
+        take_mask(mask);
+        small_multiple_of_base(mG, value);
+        apply_mask(ciphertext, mask, mG);
     }
 
+    /*
+     * c0 = r*PK + m*G and c1 = r*G, all three fixed-base multiplications
+     * over precomputed tables. r*PK and r*G come from the mask pool when
+     * one is running and has some ready.
+     */
     void encrypt(Ciphertext& ciphertext, const Plaintext& plaintext) {
-        Plaintext r;
+        EncryptionMask mask;
+        ge_p3 mG;
+
+        int64_t value;
 
-        random_bytes(r.m, sizeof(r.m));
-        x25519_sc_reduce(r.m);
-        ge_double_scalarmult_vartime(&ciphertext.c0, r.m, &pk_.data_, plaintext.m);
-        ge_scalarmult_base(&ciphertext.c1, r.m);
+        take_mask(mask);
+        if (is_short(value, plaintext))
+            small_multiple_of_base(mG, value);
+        else
+            ge_scalarmult_base(&mG, plaintext.m);
+        apply_mask(ciphertext, mask, mG);
     }
 
-    void decrypt(int64_t& value, const Ciphertext& ciphertext) {
-        Plaintext zero;
-        
-        ge_p2 R_p2;
-        ge_p1p1 R_p1p1;
+    /*
+     * Start num_threads threads computing encryption masks (r*PK, r*G)
+     * in the background, keeping up to capacity of them ready, so that
+     * encryption itself only computes m*G and one point addition. When the
+     * pool runs dry, encrypt computes its mask as usual. Starting a pool
+     * again replaces the running one; key_gen stops it.
+     */
+    void start_mask_pool(size_t capacity, int num_threads = 1) {
+        std::shared_ptr<const PreparedPublicKey> pk = pk_;
+
+        // Throws without a key, rather than in the pool threads
+        prepared_key();
+        mask_pool_.reset();
+        mask_pool_ = std::make_shared<MaskPool>(capacity, num_threads,
+            [pk](EncryptionMask& mask) { make_mask(mask, *pk); });
+    }
+
+    void stop_mask_pool() {
+        mask_pool_.reset();
+    }
+
+    /* Masks ready in the pool, 0 without one */
+    size_t mask_pool_size() const {
+        return mask_pool_ ? mask_pool_->size() : 0;
+    }
+
+    void decrypt(int64_t& value, const Ciphertext& ciphertext) const {
         ge_p3 R_p3;
-        ge_cached R_cached;
-
-
-        ge_double_scalarmult_vartime(&R_p2, sk_.data_, &ciphertext.c1, zero.m);
-        ge_p2_to_cached(&R_cached, &R_p2);
-        ge_sub(&R_p1p1, &ciphertext.c0, &R_cached);
-        ge_p1p1_to_p3(&R_p3, &R_p1p1);
-        ge_p3_to_cached(&R_cached, &R_p3);
-
-        Plaintext baby_plain;
-        ge_p3 baby_element;
-        int n = 1L << BABY_BITS; 
-        uint8_t tmp[32];
-        for(int i = 0; i < n; i++) {
-            encode(baby_plain, -i);
-            ge_scalarmult_base(&baby_element, baby_plain.m);
-            ge_add(&R_p1p1, &baby_element, &R_cached);
-            ge_p1p1_to_p2(&R_p2, &R_p1p1);
-            ge_tobytes(tmp, &R_p2);
-            size_t found = table_.count(std::string((const char*)tmp, 32));
-            
-            if (found == 0) continue; 
-
-            int64_t giant_step = table_[std::string((const char*)tmp, 32)]; 
-            value = (giant_step << BABY_BITS) + i; 
+
+        strip_mask(R_p3, ciphertext);
+        if (solver_ == DecryptSolver::Kangaroo) {
+            bool solved;
+            kangaroo_.solve(&value, &solved, &R_p3, 1, KANGAROO_WALKERS);
+            if (!solved && !solve_fallback(value, R_p3))
+                std::cout << "[ERROR] Unable to decrypt" << std::endl;
             return;
         }
+
+        if (!search_range(value, R_p3, 0, 1L << table_->baby_bits(), nullptr))
+            std::cout << "[ERROR] Unable to decrypt" << std::endl;
+    }
+
+    /*
+     * Same as decrypt, but the baby steps are split into num_threads
+     * contiguous ranges searched in parallel. Each thread reaches the start
+     * of its range with one fixed-base multiplication, and all of them stop
+     * at the next block boundary once any thread has found the value.
+     * With the kangaroo solver, each thread runs its own wild walks
+     * instead, and all stop at the next step once one has succeeded.
+     */
+    void decrypt(int64_t& value, const Ciphertext& ciphertext, unsigned num_threads) const {
+        if (num_threads <= 1) {
+            decrypt(value, ciphertext);
+            return;
+        }
+
+        ge_p3 R_p3;
+        strip_mask(R_p3, ciphertext);
+        if (solver_ == DecryptSolver::Kangaroo) {
+            decrypt_kangaroo_parallel(value, R_p3, num_threads);
+            return;
+        }
+
+        int64_t n = 1L << table_->baby_bits();
+        int64_t slice = (n + num_threads - 1) / num_threads;
+        std::atomic<bool> stop(false);
+        std::vector<int64_t> results(num_threads);
+        std::vector<char> found(num_threads, 0);
+        std::vector<std::thread> workers;
+
+        for (unsigned t = 0; t * slice < n; t++) {
+            workers.emplace_back([&, t]() {
+                int64_t lo = t * slice;
+                int64_t hi = std::min(n, lo + slice);
+
+                // start = R - lo*G
+                Plaintext offset;
+                ge_p3 start;
+                ge_cached offset_cached;
+                ge_p1p1 sum;
+                encode(offset, -lo);
+                ge_scalarmult_base(&start, offset.m);
+                ge_p3_to_cached(&offset_cached, &start);
+                ge_add(&sum, &R_p3, &offset_cached);
+                ge_p1p1_to_p3(&start, &sum);
+
+                if (search_range(results[t], start, lo, hi, &stop)) {
+                    found[t] = 1;
+                    stop = true;
+                }
+            });
+        }
+        for (size_t t = 0; t < workers.size(); t++)
+            workers[t].join();
+
+        for (size_t t = 0; t < workers.size(); t++) {
+            if (found[t]) {
+                value = results[t];
+                return;
+            }
+        }
         std::cout << "[ERROR] Unable to decrypt" << std::endl;
     }
 
+    /*
+     * Decrypt count ciphertexts at once: values[j] = Dec(ciphertexts[j]).
+     *
+     * All ciphertexts still being searched take their baby steps together,
+     * so the points of one round (at least search_block_ of them, spread
+     * over the outstanding ciphertexts) share a single field inversion and
+     * their table probes are independent of each other, so buckets are
+     * prefetched PROBE_PREFETCH_DISTANCE keys ahead; the steps
+     * themselves go through ge_msub_batch. A ciphertext leaves the batch
+     * as soon as its value is found.
+     *
+     * With the kangaroo solver, each ciphertext gets one wild walk and all
+     * walks share the field inversion of each step. With either kangaroo
+     * variant, the ciphertexts the walks give up on are searched in the
+     * baby-step-giant-step table when there is one.
+     */
+    void decrypt_batch(int64_t* values, const Ciphertext* ciphertexts, size_t count) const {
+        // points[j] = m_j*G - (baby steps taken so far)*G
+        std::vector<ge_p3> points(count);
+        std::vector<size_t> active(count);
+        for (size_t j = 0; j < count; j++) {
+            strip_mask(points[j], ciphertexts[j]);
+            active[j] = j;
+        }
+
+        if (solver_ == DecryptSolver::Kangaroo) {
+            std::unique_ptr<bool[]> solved(new bool[std::max<size_t>(count, 1)]);
+            kangaroo_.solve(values, solved.get(), points.data(), count, 1);
+            for (size_t j = 0; j < count; j++) {
+                if (!solved[j] && !solve_fallback(values[j], points[j]))
+                    std::cout << "[ERROR] Unable to decrypt ciphertext " << j << std::endl;
+            }
+            return;
+        }
+
+        const ge_precomp* base = &k25519Precomp[0][0];
+        const LookupTable& lookup = table_->lookup();
+        int baby_bits = table_->baby_bits();
+        int64_t n = 1L << baby_bits;
+        std::vector<ge_p3> candidates, walk;
+        std::vector<ge_precomp> bases;
+        std::unique_ptr<gfe[]> scratch;
+        std::vector<uint8_t> keys;
+        size_t capacity = 0;
+
+        int64_t lo = 0;
+        while (lo < n && !active.empty()) {
+            // Steps per ciphertext in this round, so that a round has at least search_block_ points
+            int64_t steps = std::min<int64_t>(n - lo,
+                (search_block_ + active.size() - 1) / active.size());
+            size_t total = active.size() * steps;
+            if (total > capacity) {
+                capacity = total;
+                candidates.resize(capacity);
+                scratch.reset(new gfe[2 * capacity]);
+                keys.resize(32 * capacity);
+            }
+
+            // Walk the active points side by side, one ge_msub_batch per step
+            walk.resize(active.size());
+            bases.assign(active.size(), *base);
+            for (size_t a = 0; a < active.size(); a++)
+                walk[a] = points[active[a]];
+            for (int64_t s = 0; s < steps; s++) {
+                for (size_t a = 0; a < active.size(); a++)
+                    candidates[a * steps + s] = walk[a];
+                ge_msub_batch(walk.data(), walk.data(), bases.data(), walk.size());
+            }
+            for (size_t a = 0; a < active.size(); a++)
+                points[active[a]] = walk[a];
+            ge_p3_batch_tobytes(keys.data(), candidates.data(), scratch.get(), total);
+
+            // Keep PROBE_PREFETCH_DISTANCE buckets on their way while probing
+            for (size_t i = 0; i < std::min<size_t>(total, PROBE_PREFETCH_DISTANCE); i++)
+                lookup.prefetch(&keys[32 * i]);
+
+            size_t remaining = 0;
+            for (size_t a = 0; a < active.size(); a++) {
+                size_t j = active[a];
+                bool found = false;
+                for (int64_t s = 0; s < steps && !found; s++) {
+                    size_t i = a * steps + s;
+                    if (i + PROBE_PREFETCH_DISTANCE < total)
+                        lookup.prefetch(&keys[32 * (i + PROBE_PREFETCH_DISTANCE)]);
+
+                    int64_t giant_step;
+                    if (!lookup_giant_step(lookup, &keys[32 * i], giant_step))
+                        continue;
+
+                    values[j] = giant_step * ((int64_t)1 << baby_bits) + lo + s;
+                    found = true;
+                }
+                if (!found)
+                    active[remaining++] = j;
+            }
+            active.resize(remaining);
+            lo += steps;
+        }
+
+        for (size_t a = 0; a < active.size(); a++)
+            std::cout << "[ERROR] Unable to decrypt ciphertext " << active[a] << std::endl;
+    }
+
     void hom_add(Ciphertext& c, const Ciphertext& a, const Ciphertext& b) {
         ge_cached t0;
         ge_p1p1 t1; 
@@ -284,6 +578,27 @@ public:
         ge_p1p1_to_p3(&c.c1, &t1);
     }
 
+    /*
+     * c[i] = a[i] + b[i] for i < count, as one ge_add_batch over the 2*count
+     * point additions. c may alias a or b.
+     */
+    void hom_add(Ciphertext* c, const Ciphertext* a, const Ciphertext* b, size_t count) {
+        std::vector<ge_p3> sums(2 * count);
+        std::vector<ge_cached> addends(2 * count);
+
+        for (size_t i = 0; i < count; i++) {
+            sums[2 * i] = a[i].c0;
+            sums[2 * i + 1] = a[i].c1;
+            ge_p3_to_cached(&addends[2 * i], &b[i].c0);
+            ge_p3_to_cached(&addends[2 * i + 1], &b[i].c1);
+        }
+        ge_add_batch(sums.data(), sums.data(), addends.data(), 2 * count);
+        for (size_t i = 0; i < count; i++) {
+            c[i].c0 = sums[2 * i];
+            c[i].c1 = sums[2 * i + 1];
+        }
+    }
+
     void hom_sub(Ciphertext& c, const Ciphertext& a, const Ciphertext& b) {
         ge_cached t0;
         ge_p1p1 t1; 
@@ -302,7 +617,7 @@ public:
         ge_cached tmp1;
         ge_p1p1 tmp2;
 
-        ge_scalarmult_base(&tmp0, plain.m);
+        plain_multiple_of_base(tmp0, plain);
         ge_p3_to_cached(&tmp1, &tmp0);
         ge_add(&tmp2, &encrypted.c0, &tmp1);
         
@@ -318,7 +633,7 @@ public:
         ge_cached tmp1;
         ge_p1p1 tmp2;
 
-        ge_scalarmult_base(&tmp0, plain.m);
+        plain_multiple_of_base(tmp0, plain);
         ge_p3_to_cached(&tmp1, &tmp0);
         ge_sub(&tmp2, &encrypted.c0, &tmp1);
         
@@ -329,40 +644,199 @@ public:
             sizeof(destination.c1)); 
     }
 
+    /*
+     * When plain stands for a signed 64-bit value, see the int64_t
+     * overload. Otherwise a generic scalar multiplication over the 256
+     * bits of plain.
+     */
     void hom_mul(Ciphertext& destination, const Ciphertext& encrypted, const Plaintext& plain) {
         Plaintext zero;
+        int64_t value;
+
+        if (signed_value(value, plain)) {
+            hom_mul(destination, encrypted, value);
+            return;
+        }
 
         ge_double_scalarmult_vartime(&destination.c0, plain.m, &encrypted.c0, zero.m);
 
         ge_double_scalarmult_vartime(&destination.c1, plain.m, &encrypted.c1, zero.m);
     }
 
-    void hom_negate(Ciphertext& destination, const Ciphertext& encrypted) {
-        uint8_t zero[32] = {0};
-        ge_double_scalarmult_vartime(&destination.c0, neg_one_, &encrypted.c0, zero);
-        ge_double_scalarmult_vartime(&destination.c1, neg_one_, &encrypted.c1, zero);
+    /*
+     * destination = constant*encrypted for a constant not encoded first:
+     * its magnitude is a short scalar, multiplied by as an addition chain
+     * (see ge_scalarmult_small_vartime), and a negative constant costs one
+     * point negation. 2 is one doubling, 10 three doublings and an addition.
+     */
+    void hom_mul(Ciphertext& destination, const Ciphertext& encrypted, int64_t constant) {
+        uint64_t magnitude = constant < 0 ? 0 - (uint64_t)constant : (uint64_t)constant;
+
+        ge_scalarmult_small_vartime(&destination.c0, magnitude, &encrypted.c0);
+        ge_scalarmult_small_vartime(&destination.c1, magnitude, &encrypted.c1);
+        if (constant < 0) {
+            ge_p3_neg(&destination.c0, &destination.c0);
+            ge_p3_neg(&destination.c1, &destination.c1);
+        }
     }
 
-    void save_table(std::ostream& stream) {
-        size_t n = table_.size();
-        stream.write((const char*)&n, sizeof(size_t));
-        for (auto it = table_.begin(); it != table_.end(); ++it) {
-            stream.write(it->first.data(), it->first.size());
-            stream.write((const char*)&it->second, sizeof(int));
+    /*
+     * destination = plain[0]*encrypted[0] + ... + plain[count-1]*encrypted[count-1],
+     * the same as hom_mul and hom_add in a loop, as one multi-scalar
+     * multiplication over the c0 and one over the c1 (see msm.h). When all
+     * weights stand for signed 64-bit values, the scalars are their
+     * magnitudes, as short as the largest of them, with the points of
+     * negative weights negated.
+     */
+    void hom_inner_product(Ciphertext& destination, const Ciphertext* encrypted,
+                           const Plaintext* plain, size_t count) {
+        std::vector<uint8_t> scalars(32 * count);
+        std::vector<ge_p3> points(count);
+        std::vector<int64_t> values(count);
+        bool short_weights = true;
+        int bits = 1;
+
+        for (size_t i = 0; i < count && short_weights; i++)
+            short_weights = signed_value(values[i], plain[i]);
+
+        for (size_t i = 0; i < count; i++) {
+            if (short_weights) {
+                uint64_t magnitude = values[i] < 0 ? 0 - (uint64_t)values[i]
+                                                   : (uint64_t)values[i];
+                for (int j = 0; j < 8; j++)
+                    scalars[32 * i + j] = (uint8_t)(magnitude >> (8 * j));
+                while (bits < 64 && (magnitude >> bits) != 0)
+                    bits++;
+            } else {
+                memcpy(&scalars[32 * i], plain[i].m, 32);
+            }
         }
+        if (!short_weights)
+            bits = 255;
+
+        for (int half = 0; half < 2; half++) {
+            for (size_t i = 0; i < count; i++) {
+                const ge_p3& point = half == 0 ? encrypted[i].c0 : encrypted[i].c1;
+                if (short_weights && values[i] < 0)
+                    ge_p3_neg(&points[i], &point);
+                else
+                    points[i] = point;
+            }
+            ge_msm_vartime(half == 0 ? &destination.c0 : &destination.c1,
+                           scalars.data(), points.data(), count, bits);
+        }
+    }
+
+    /* -(x,y) = (-x,y): four field negations, no scalar multiplication */
+    void hom_negate(Ciphertext& destination, const Ciphertext& encrypted) {
+        ge_p3_neg(&destination.c0, &encrypted.c0);
+        ge_p3_neg(&destination.c1, &encrypted.c1);
+    }
+
+    /* destination = 2*encrypted, one point doubling per half */
+    void hom_double(Ciphertext& destination, const Ciphertext& encrypted) {
+        ge_p1p1 t;
+
+        ge_p3_dbl(&t, &encrypted.c0);
+        ge_p1p1_to_p3(&destination.c0, &t);
+        ge_p3_dbl(&t, &encrypted.c1);
+        ge_p1p1_to_p3(&destination.c1, &t);
+    }
+
+    /*
+     * Write the table, including its split, in the format described in
+     * table_file.h.
+     */
+    void save_table(std::ostream& stream) const {
+        table_->save(stream);
     }
 
+    /*
+     * Read a table written by save_table into memory. The split recorded
+     * in the file replaces the current one.
+     */
     void load_table(std::istream& stream) {
-        size_t n = 0;
-        stream.read((char*)&n, sizeof(size_t));
-        table_.reserve(n);
-        char buf[32];
-        int step = 0;
-        for (size_t i = 0; i < n; i++) {
-            stream.read(buf, 32);
-            stream.read((char*)&step, sizeof(int));
-            table_[std::string((const char*)buf, 32)] = step;
-        }
+        std::shared_ptr<DecryptionTable> table = std::make_shared<DecryptionTable>();
+        table->set_placement(placement_);
+        table->load(stream);
+        table_ = table;
+    }
+
+    /*
+     * Use a table file written by save_table in place from a read-only
+     * shared mapping (see DecryptionTable::map).
+     */
+    void map_table(const std::string& path, bool verify_checksum = false) {
+        std::shared_ptr<DecryptionTable> table = std::make_shared<DecryptionTable>();
+        table->set_placement(placement_);
+        table->map(path, verify_checksum);
+        table_ = table;
+    }
+
+    /*
+     * Use the table of the file written by save_table from the shared
+     * memory segment holding it for all processes on the host, creating
+     * the segment from the file if no process has yet (see TableRegistry).
+     * Instances of one process share the same DecryptionTable, placed as
+     * asked by the first of them.
+     */
+    void load_shared_table(const std::string& path) {
+        table_ = TableRegistry::instance().load(path, placement_);
+    }
+
+    void load_shared_table(std::istream& stream) {
+        table_ = TableRegistry::instance().load(stream, placement_);
+    }
+
+    /*
+     * Pages, NUMA replicas and prefaulting of the tables built, loaded or
+     * mapped from now on (see table_memory.h). With 2 MB pages, probing a
+     * table of several GB no longer misses the TLB on almost every lookup.
+     */
+    void set_table_placement(const TablePlacement& placement) {
+        placement_ = placement;
+    }
+
+    const TablePlacement& table_placement() const {
+        return placement_;
+    }
+
+    const DecryptionTable& decrypt_table() const {
+        return *table_;
+    }
+
+    /*
+     * The table is immutable once built, loaded or mapped, and decryption
+     * only reads it, so any number of instances (say, one per worker
+     * thread, each with its own key) can share one copy of it: hand the
+     * pointer from shared_decrypt_table to set_decrypt_table. Building,
+     * loading or mapping a table again replaces the pointer of this
+     * instance only. Replacing it is not safe while this same instance is
+     * decrypting in another thread.
+     */
+    std::shared_ptr<const DecryptionTable> shared_decrypt_table() const {
+        return table_;
+    }
+
+    void set_decrypt_table(const std::shared_ptr<const DecryptionTable>& table) {
+        if (!table)
+            throw std::invalid_argument("Decryption table must not be null");
+        table_ = table;
+    }
+
+    /*
+     * Write the kangaroo table (parameters and distinguished points).
+     */
+    void save_kangaroo_table(std::ostream& stream) {
+        kangaroo_.save(stream);
+    }
+
+    void load_kangaroo_table(std::istream& stream) {
+        kangaroo_.load(stream);
+    }
+
+    const KangarooTable& kangaroo_table() const {
+        return kangaroo_;
     }
 
     //virtual void save_pk(std::ostream& stream) = 0;
@@ -370,7 +844,345 @@ public:
     //virtual void load_pk(std::istream& stream) = 0;
 
 private:
-    PublicKey pk_;
+    static void check_message_range(int64_t value) {
+        // This library can handle at most 40-bit messages (with sign bit): [-2^39, 2^39-1]
+        int64_t upper_bound = (1L << 39) - 1;
+        int64_t lower_bound = -(1L << 39);
+        if (value > upper_bound || value < lower_bound)
+            throw std::invalid_argument("Input value out of supported range [-2^39, 2^39-1]");
+    }
+
+    static void make_mask(EncryptionMask& mask, const PreparedPublicKey& pk) {
+        uint8_t r[32];
+
+        random_scalar(r);
+        ge_scalarmult_table(&mask.rPK, r, pk.table_);
+        ge_scalarmult_base(&mask.rG, r);
+    }
+
+    void take_mask(EncryptionMask& mask) {
+        if (!mask_pool_ || !mask_pool_->pop(mask))
+            make_mask(mask, prepared_key());
+    }
+
+    /* A default-constructed instance has no public key before key_gen */
+    const PreparedPublicKey& prepared_key() const {
+        if (!pk_)
+            throw std::logic_error("No public key");
+        return *pk_;
+    }
+
+    static void apply_mask(Ciphertext& ciphertext, const EncryptionMask& mask, const ge_p3& mG) {
+        ge_cached mG_cached;
+        ge_p1p1 t;
+
+        ge_p3_to_cached(&mG_cached, &mG);
+        ge_add(&t, &mask.rPK, &mG_cached);
+        ge_p1p1_to_p3(&ciphertext.c0, &t);
+        ciphertext.c1 = mask.rG;
+    }
+
+    /*
+     * h = value*G, for |value| < 2^(8*len-1) and len <= 6, negated in
+     * constant time
+     */
+    static void small_multiple_of_base(ge_p3& h, int64_t value, int len = 6) {
+        uint64_t sign = (uint64_t)(value >> 63);
+        uint64_t magnitude = ((uint64_t)value ^ sign) - sign;
+        uint8_t bytes[6];
+        gfe x, t;
+
+        for (int i = 0; i < len; i++)
+            bytes[i] = (uint8_t)(magnitude >> (8 * i));
+        ge_scalarmult_table_short(&h, bytes, len, k25519Precomp);
+        gfe_neg(x, h.X);
+        gfe_neg(t, h.T);
+        gfe_cmov(h.X, x, (unsigned int)(sign & 1));
+        gfe_cmov(h.T, t, (unsigned int)(sign & 1));
+    }
+
+    /* Whether scalar s is below 2^63, and then its value x */
+    static bool scalar_below_2_63(uint64_t& x, const uint8_t s[32]) {
+        for (int i = 8; i < 32; i++)
+            if (s[i] != 0)
+                return false;
+        x = 0;
+        for (int i = 0; i < 8; i++)
+            x |= ((uint64_t)s[i]) << (8 * i);
+        return x < (1ULL << 63);
+    }
+
+    /*
+     * The signed value plain stands for, if any: m itself when below 2^63,
+     * or -(L - m) when L - m is. Read off m on every call, so that any
+     * plaintext, not only one made by encode, takes the short paths.
+     */
+    bool signed_value(int64_t& value, const Plaintext& plain) const {
+        uint8_t neg[32];
+        uint64_t magnitude;
+        int borrow = 0;
+
+        if (scalar_below_2_63(magnitude, plain.m)) {
+            value = (int64_t)magnitude;
+            return true;
+        }
+        for (int i = 0; i < 32; i++) {
+            int d = (int)L_[i] - plain.m[i] - borrow;
+            neg[i] = (uint8_t)d;
+            borrow = d < 0;
+        }
+        if (borrow || !scalar_below_2_63(magnitude, neg))
+            return false;
+        value = -(int64_t)magnitude;
+        return true;
+    }
+
+    /* Whether plain stands for a value small_multiple_of_base takes */
+    bool is_short(int64_t& value, const Plaintext& plain) const {
+        return signed_value(value, plain) && value < (1L << 47) && value > -(1L << 47);
+    }
+
+    /*
+     * h = plain*G, walking only as many rows of the base point table as
+     * the value of plain needs when it is short
+     */
+    void plain_multiple_of_base(ge_p3& h, const Plaintext& plain) const {
+        int64_t value;
+
+        if (!is_short(value, plain)) {
+            ge_scalarmult_base(&h, plain.m);
+            return;
+        }
+        uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+        int len = 1;
+        while (len < 6 && (magnitude >> (8 * len - 1)) != 0)
+            len++;
+        small_multiple_of_base(h, value, len);
+    }
+
+    /*
+     * Write the compressed points of giant steps first, ..., first+count-1
+     * to keys. The range is cut into GE_BATCH_WIDTH consecutive pieces
+     * walked side by side, so that each step is one ge_madd_batch: one
+     * fixed-base multiplication for the first entry of each piece, then
+     * repeated addition of step = 2^{baby_bits}*G, normalized in blocks.
+     */
+    void precompute_range(int64_t first, int64_t count, int baby_bits, const ge_precomp* step,
+                          uint8_t* keys) const {
+        Plaintext plain;
+        int64_t lanes = std::max<int64_t>(1, std::min<int64_t>(GE_BATCH_WIDTH, count));
+        int64_t piece = (count + lanes - 1) / lanes;
+
+        std::vector<ge_p3> points(lanes);
+        std::vector<ge_precomp> steps(lanes, *step);
+        for (int64_t k = 0; k < lanes; k++) {
+            encode_scalar(plain, (first + k * piece) * ((int64_t)1 << baby_bits));
+            ge_scalarmult_base(&points[k], plain.m);
+        }
+
+        std::vector<ge_p3> entries(lanes * search_block_);
+        std::vector<uint8_t> block_keys(32 * lanes * search_block_);
+        std::unique_ptr<gfe[]> scratch(new gfe[2 * lanes * search_block_]);
+        for (int64_t lo = 0; lo < piece; lo += search_block_) {
+            int block = (int)std::min<int64_t>(search_block_, piece - lo);
+            for (int j = 0; j < block; j++) {
+                for (int64_t k = 0; k < lanes; k++)
+                    entries[k * block + j] = points[k];
+                ge_madd_batch(points.data(), points.data(), steps.data(), lanes);
+            }
+            ge_p3_batch_tobytes(block_keys.data(), entries.data(), scratch.get(), lanes * block);
+
+            // The last piece may be shorter than the others
+            for (int64_t k = 0; k < lanes; k++) {
+                int64_t begin = k * piece + lo;
+                int64_t n = std::min<int64_t>(block, count - begin);
+                if (n > 0)
+                    memcpy(keys + 32 * begin, &block_keys[32 * k * block], 32 * n);
+            }
+        }
+    }
+
+    /*
+     * Baby steps lo, ..., hi-1 of the search, where start = R - lo*G: walk
+     * start, start-G, start-2G, ... by subtracting the base point
+     * (k25519Precomp[0][0] = G in precomputed form) at each step,
+     * instead of a full fixed-base multiplication for every -i*G.
+     * Candidates are produced search_block_ at a time and compressed
+     * together, so the field inversion is paid once per block.
+     *
+     * Each block is probed while the next one is computed: every step
+     * prefetches the bucket of one key of the previous block, and the
+     * previous block is probed once the step loop is done. The cache
+     * misses of a large table then overlap the point arithmetic, at the
+     * cost of finding a hit one block later.
+     *
+     * Gives up early, between blocks, once *stop is set.
+     */
+    bool search_range(int64_t& value, const ge_p3& start, int64_t lo, int64_t hi,
+                      const std::atomic<bool>* stop) const {
+        ge_p1p1 R_p1p1;
+        ge_p3 R_p3 = start;
+
+        const ge_precomp* base = &k25519Precomp[0][0];
+        const LookupTable& lookup = table_->lookup();
+        int baby_bits = table_->baby_bits();
+        std::vector<ge_p3> candidates(search_block_);
+        std::unique_ptr<gfe[]> scratch(new gfe[2 * search_block_]);
+        // Keys of the block being computed, and of the previous one
+        std::vector<uint8_t> keys(32 * search_block_), pending(32 * search_block_);
+        int64_t pending_lo = lo;
+        int pending_count = 0;
+        for (;;) {
+            if (stop != nullptr && stop->load(std::memory_order_relaxed))
+                return false;
+
+            int count = (int)std::max<int64_t>(0, std::min<int64_t>(search_block_, hi - lo));
+            for (int j = 0; j < count; j++) {
+                if (j < pending_count)
+                    lookup.prefetch(&pending[32 * j]);
+                candidates[j] = R_p3;
+                ge_msub(&R_p1p1, &R_p3, base);
+                ge_p1p1_to_p3(&R_p3, &R_p1p1);
+            }
+            for (int j = count; j < pending_count; j++)
+                lookup.prefetch(&pending[32 * j]);
+
+            for (int j = 0; j < pending_count; j++) {
+                int64_t giant_step;
+                if (!lookup_giant_step(lookup, &pending[32 * j], giant_step))
+                    continue;
+
+                value = giant_step * ((int64_t)1 << baby_bits) + pending_lo + j;
+                return true;
+            }
+            if (count == 0)
+                return false;
+
+            ge_p3_batch_tobytes(keys.data(), candidates.data(), scratch.get(), count);
+            keys.swap(pending);
+            pending_lo = lo;
+            pending_count = count;
+            lo += count;
+        }
+    }
+
+    /* Kangaroo counterpart of the threaded decrypt: num_threads independent searches */
+    void decrypt_kangaroo_parallel(int64_t& value, const ge_p3& R, unsigned num_threads) const {
+        std::atomic<bool> stop(false);
+        std::vector<int64_t> results(num_threads);
+        std::unique_ptr<bool[]> found(new bool[num_threads]);
+        std::vector<std::thread> workers;
+
+        for (unsigned t = 0; t < num_threads; t++) {
+            workers.emplace_back([&, t]() {
+                kangaroo_.solve(&results[t], &found[t], &R, 1, KANGAROO_WALKERS, &stop, t);
+                if (found[t])
+                    stop = true;
+            });
+        }
+        for (size_t t = 0; t < workers.size(); t++)
+            workers[t].join();
+
+        for (unsigned t = 0; t < num_threads; t++) {
+            if (found[t]) {
+                value = results[t];
+                return;
+            }
+        }
+        if (!solve_fallback(value, R))
+            std::cout << "[ERROR] Unable to decrypt" << std::endl;
+    }
+
+    /*
+     * Kangaroo walks give up, rarely, on logarithms in range, where
+     * baby-step-giant-step never fails: the table built or loaded for it,
+     * if any, settles them.
+     */
+    bool solve_fallback(int64_t& value, const ge_p3& R) const {
+        return !table_->empty() && search_range(value, R, 0, 1L << table_->baby_bits(), nullptr);
+    }
+
+    /*
+     * Scalar of value mod L, for any int64 value. Used directly for
+     * internal multiples of G that may exceed the message range.
+     */
+    void encode_scalar(Plaintext& plain, int64_t value) const {
+        memset(plain.m, 0, sizeof(plain.m));
+        for (int i = 0; i < 8; i++) {
+            plain.m[i] = (value >> (8*i)) & 0xFFL;
+        }
+
+        // Positive encodinng finishes here
+        if (value >= 0)
+            return;
+
+        // Next handles negative encoding 
+
+        for (int i = 8; i < 32; i++)
+            plain.m[i] = 255;
+
+        // Add plain with L, essentially a modulo operation
+        uint8_t carry = 0;
+        for (int i = 0; i < 32; i++) {
+            if (carry == 1 && plain.m[i] == 255) {
+                plain.m[i] += L_[i] + carry;
+                carry = 1;
+            }
+            else if ( (255 - carry - plain.m[i]) < L_[i] ) {
+                plain.m[i] += L_[i] + carry;
+                carry = 1;
+            }
+            else {
+                plain.m[i] += L_[i] + carry;
+                carry = 0;
+            }
+        }
+    }
+
+    /* R = c0 - sk*c1 = m*G */
+    void strip_mask(ge_p3& R, const Ciphertext& ciphertext) const {
+        Plaintext zero;
+        ge_p1p1 t;
+        ge_cached mask;
+
+        ge_double_scalarmult_vartime(&R, sk_.data_, &ciphertext.c1, zero.m);
+        ge_p3_to_cached(&mask, &R);
+        ge_sub(&t, &ciphertext.c0, &mask);
+        ge_p1p1_to_p3(&R, &t);
+    }
+
+    /*
+     * The table only keeps a fingerprint of each point, so a match is
+     * confirmed by recomputing the giant step and comparing full points.
+     * In a symmetric table, a point matching except for the sign of x
+     * (bit 255) is the negated giant step. lookup is the copy of the table
+     * the caller picked once for the thread (see DecryptionTable::lookup).
+     */
+    bool lookup_giant_step(const LookupTable& lookup, const uint8_t key[32],
+                           int64_t& giant_step) const {
+        bool symmetric = table_->symmetric();
+        return lookup.find(key, [&](int32_t candidate) {
+            Plaintext plain;
+            ge_p3 point;
+            uint8_t bytes[32];
+
+            encode_scalar(plain, (int64_t)candidate * ((int64_t)1 << table_->baby_bits()));
+            ge_scalarmult_base(&point, plain.m);
+            ge_p3_tobytes(bytes, &point);
+            if (memcmp(bytes, key, 31) != 0 || ((bytes[31] ^ key[31]) & 0x7F) != 0)
+                return false;
+
+            if (bytes[31] == key[31])
+                giant_step = candidate;
+            else if (symmetric)
+                giant_step = -(int64_t)candidate;
+            else
+                return false;
+            return true;
+        });
+    }
+
+    std::shared_ptr<const PreparedPublicKey> pk_;
     SecretKey sk_;
 
     /* Group order is L = 2^252 + 27742317777372353535851937790883648493. */
@@ -381,16 +1193,15 @@ private:
         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
     };
 
-    /* L-1 (-1 for signed number) */
-    uint8_t neg_one_[32] = {
-        0xEC, 0xD3, 0xF5, 0x5C, 0x1A, 0x63, 0x12, 0x58, 
-        0xD6, 0x9C, 0xF7, 0xA2, 0xDE, 0xF9, 0xDE, 0x14, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
-    };
+    /* Shared between copies and instances, see set_decrypt_table */
+    std::shared_ptr<const DecryptionTable> table_ = std::make_shared<DecryptionTable>();
+    TablePlacement placement_;
+    KangarooTable kangaroo_;
+    DecryptSolver solver_ = DecryptSolver::BabyStepGiantStep;
+
+    int search_block_ = SEARCH_BLOCK;
 
-    //uint8_t table_[1<<GIANT_BITS][32];
-    std::unordered_map<std::string, int> table_;
+    std::shared_ptr<MaskPool> mask_pool_;
 
     bool has_sk_;
 };
@@ -1,12 +1,151 @@
 
+#include <sstream>
+#include <sys/wait.h>
 #include "test.h"
 
 using namespace std;
 
+// A small split keeps the table precomputation in each test fast
+#define TEST_MSG_BITS 20
+#define TEST_BABY_BITS 10
+
+
+void test_invert() {
+#if defined(GE_BASE_2_51)
+    // 0, 1, p-1, p, 2^255-1 and a few others, against Fermat's addition chain
+    uint8_t inputs[8][32];
+    memset(inputs, 0, sizeof(inputs));
+    inputs[1][0] = 1;
+    memset(inputs[2], 0xff, 32);
+    inputs[2][0] = 0xec;
+    inputs[2][31] = 0x7f;
+    memset(inputs[3], 0xff, 32);
+    inputs[3][0] = 0xed;
+    inputs[3][31] = 0x7f;
+    memset(inputs[4], 0xff, 32);
+    inputs[4][31] = 0x7f;
+    for (int i = 0; i < 32; i++) {
+        inputs[5][i] = (uint8_t)(i * 37 + 11);
+        inputs[6][i] = (uint8_t)(255 - i * 5);
+        inputs[7][i] = (uint8_t)(i * i + 3);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        fe51 z51;
+        gfe z, r;
+        uint8_t expected[32], bytes[32];
+        fe51_frombytes(z51, inputs[i]);
+        fe51_invert(z51, z51);
+        fe51_tobytes(expected, z51);
+        gfe_frombytes(z, inputs[i]);
+
+        gfe_invert(r, z);
+        gfe_tobytes(bytes, r);
+        assert (memcmp(expected, bytes, 32) == 0);
+
+        gfe_invert_vartime(r, z);
+        gfe_tobytes(bytes, r);
+        assert (memcmp(expected, bytes, 32) == 0);
+    }
+#endif
+    cout << "Test invert succeeds" << endl;
+}
+
+void test_random_source() {
+    // ChaCha20 block function test vector of RFC 8439, section 2.3.2
+    uint32_t key[8], nonce[3] = {0x09000000, 0x4a000000, 0};
+    uint8_t block[64];
+    for (int i = 0; i < 8; i++)
+        key[i] = (uint32_t)(4 * i) | (uint32_t)(4 * i + 1) << 8 |
+                 (uint32_t)(4 * i + 2) << 16 | (uint32_t)(4 * i + 3) << 24;
+    chacha20_block(block, key, 1, nonce);
+    const uint8_t expected[64] = {
+        0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+        0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+        0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+        0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e
+    };
+    assert (memcmp(block, expected, 64) == 0);
+
+    // Seeded generators repeat, however the output is split into calls
+    ChaCha20Drbg a(42), b(42), c(43);
+    uint8_t x[1000], y[1000], z[1000];
+    a.fill(x, 1000);
+    for (int i = 0; i < 1000; i += 37)
+        b.fill(y + i, min(37, 1000 - i));
+    c.fill(z, 1000);
+    assert (memcmp(x, y, 1000) == 0);
+    assert (memcmp(x, z, 1000) != 0);
+
+    // Key pairs and ciphertexts are reproducible under a seeded source
+    Ciphertext ct[2];
+    uint8_t pk[2][32];
+    for (int run = 0; run < 2; run++) {
+        ChaCha20Drbg seeded(7);
+        set_random_source(&seeded);
+        LHE25519 scheme;
+        scheme.key_gen();
+        scheme.encrypt(ct[run], 1234);
+        set_random_source(nullptr);
+        ge_p3_tobytes(pk[run], &scheme.public_key().data_);
+    }
+    uint8_t b1[32], b2[32];
+    ge_p3_tobytes(b1, &ct[0].c1);
+    ge_p3_tobytes(b2, &ct[1].c1);
+    assert (memcmp(pk[0], pk[1], 32) == 0);
+    assert (memcmp(b1, b2, 32) == 0);
+
+    // A seeded source is shared by the mask pool threads
+    {
+        ChaCha20Drbg seeded(9);
+        set_random_source(&seeded);
+        LHE25519 scheme;
+        scheme.key_gen();
+        scheme.start_mask_pool(64, 4);
+        vector<thread> threads;
+        for (int t = 0; t < 2; t++)
+            threads.emplace_back([]() {
+                uint8_t r[32];
+                for (int i = 0; i < 100; i++)
+                    random_scalar(r);
+            });
+        for (auto& th : threads)
+            th.join();
+        scheme.stop_mask_pool();
+        set_random_source(nullptr);
+    }
+
+    // A forked child does not repeat the parent's per-thread stream
+    uint8_t before[32], parent[32], child[32];
+    random_bytes(before, 32);
+    int fds[2];
+    assert (pipe(fds) == 0);
+    pid_t pid = fork();
+    assert (pid >= 0);
+    if (pid == 0) {
+        random_bytes(child, 32);
+        _exit(write(fds[1], child, 32) == 32 ? 0 : 1);
+    }
+    random_bytes(parent, 32);
+    assert (read(fds[0], child, 32) == 32);
+    int status;
+    waitpid(pid, &status, 0);
+    assert (WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    close(fds[0]);
+    close(fds[1]);
+    assert (memcmp(parent, child, 32) != 0);
+
+    // Scalars from the default source are reduced modulo L
+    uint8_t s[32];
+    random_scalar(s);
+    assert (s[31] <= 0x10);
+
+    cout << "Test random source succeeds" << endl;
+}
 
 void test_enc_dec() {
     LHE25519 scheme;
-    scheme.precompute_decrypt_table();
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
     scheme.key_gen();
 
     Ciphertext ct1, ct2;
@@ -23,12 +162,217 @@ void test_enc_dec() {
     assert (x1 == -98);
     assert (x2 == 46);
 
+    // Encrypting an int64_t checks the same range as encode
+    int64_t out_of_range[] = {1L << 39, -(1L << 39) - 1};
+    for (int64_t value : out_of_range) {
+        bool thrown = false;
+        try {
+            scheme.encrypt(ct1, value);
+        } catch (const invalid_argument&) {
+            thrown = true;
+        }
+        assert (thrown);
+    }
+
     cout << "Test encryption and decryption succeeds" << endl;
 }
 
+void test_base_point() {
+    // Compressed Ed25519 base point: y = 4/5, x positive
+    uint8_t expected[32];
+    memset(expected, 0x66, sizeof(expected));
+    expected[0] = 0x58;
+
+    uint8_t one[32] = {1};
+    uint8_t bytes[32];
+    ge_p3 point;
+    ge_scalarmult_base(&point, one);
+    ge_p3_tobytes(bytes, &point);
+    assert (memcmp(bytes, expected, 32) == 0);
+
+    // 7*B two ways: 1*(2*B) + 5*B, and with the fixed-base tables
+    uint8_t two[32] = {2}, five[32] = {5}, seven[32] = {7}, other[32];
+    ge_p3 twice;
+    ge_scalarmult_base(&twice, two);
+    ge_double_scalarmult_vartime(&point, one, &twice, five);
+    ge_p3_tobytes(bytes, &point);
+    ge_scalarmult_base(&point, seven);
+    ge_p3_tobytes(other, &point);
+    assert (memcmp(bytes, other, 32) == 0);
+
+    cout << "Test base point succeeds" << endl;
+}
+
+void test_field_backends() {
+#if defined(BASE_2_64_IMPLEMENTED) && defined(BASE_2_51_IMPLEMENTED)
+    if (!x25519_fe64_eligible()) {
+        cout << "Test field backends skipped (no BMI2/ADX)" << endl;
+        return;
+    }
+
+    // fe64 against fe51, including inputs at and above p = 2^255-19
+    uint8_t inputs[4][32];
+    memset(inputs[0], 0xff, 32);
+    memset(inputs[1], 0xff, 32);
+    inputs[1][0] = 0xed;
+    inputs[1][31] = 0x7f;
+    for (int i = 0; i < 32; i++) {
+        inputs[2][i] = (uint8_t)(i * 37 + 11);
+        inputs[3][i] = (uint8_t)(255 - i * 5);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            fe51 f51, g51, h51;
+            fe64 f64, g64, h64;
+            uint8_t bytes51[32], bytes64[32];
+            fe51_frombytes(f51, inputs[i]);
+            fe51_frombytes(g51, inputs[j]);
+            fe64_frombytes(f64, inputs[i]);
+            fe64_frombytes(g64, inputs[j]);
+
+            fe51_mul(h51, f51, g51);
+            fe64_mul(h64, f64, g64);
+            fe51_sub(h51, h51, g51);
+            fe64_sub(h64, h64, g64);
+            fe51_sq(f51, f51);
+            fe64_sqr(f64, f64);
+            fe51_add(h51, h51, f51);
+            fe64_add(h64, h64, f64);
+            fe51_tobytes(bytes51, h51);
+            fe64_tobytes(bytes64, h64);
+            assert (memcmp(bytes51, bytes64, 32) == 0);
+
+            fe51_invert(h51, h51);
+            fe64_invert(h64, h64);
+            fe51_tobytes(bytes51, h51);
+            fe64_tobytes(bytes64, h64);
+            assert (memcmp(bytes51, bytes64, 32) == 0);
+        }
+    }
+#endif
+    cout << "Test field backends succeeds (" << ge_backend_name() << ")" << endl;
+}
+
+void test_prepared_public_key() {
+    LHE25519 scheme;
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    scheme.key_gen();
+
+    // r*PK from the table against the sliding-window multiplication
+    uint8_t r[32], zero[32];
+    memset(zero, 0, 32);
+    for (int i = 0; i < 32; i++)
+        r[i] = (uint8_t)(i * 29 + 7);
+    r[31] &= 127;
+    ge_p3 expected, actual;
+    ge_double_scalarmult_vartime(&expected, r, &scheme.public_key().data_, zero);
+    ge_scalarmult_table(&actual, r, scheme.prepared_public_key()->table_);
+    uint8_t b1[32], b2[32];
+    ge_p3_tobytes(b1, &expected);
+    ge_p3_tobytes(b2, &actual);
+    assert (memcmp(b1, b2, 32) == 0);
+
+    // Encryptors holding only the public key, plain or already prepared
+    LHE25519 from_key(scheme.public_key());
+    LHE25519 from_prepared(scheme.prepared_public_key());
+    Ciphertext ct1, ct2;
+    from_key.encrypt(ct1, -123);
+    from_prepared.encrypt(ct2, 4567);
+    int64_t x1, x2;
+    scheme.decrypt(x1, ct1);
+    scheme.decrypt(x2, ct2);
+    assert (x1 == -123);
+    assert (x2 == 4567);
+
+    // Without a key, encryption fails cleanly
+    LHE25519 keyless;
+    assert (!keyless.prepared_public_key());
+    int failures = 0;
+    try {
+        keyless.public_key();
+    } catch (const logic_error&) {
+        failures++;
+    }
+    try {
+        keyless.encrypt(ct1, 1);
+    } catch (const logic_error&) {
+        failures++;
+    }
+    try {
+        keyless.start_mask_pool(4);
+    } catch (const logic_error&) {
+        failures++;
+    }
+    assert (failures == 3);
+
+    // Copies and encryptors made from the prepared key share its table
+    LHE25519 copy = scheme;
+    assert (copy.prepared_public_key() == scheme.prepared_public_key());
+    assert (from_prepared.prepared_public_key() == scheme.prepared_public_key());
+
+    cout << "Test prepared public key succeeds" << endl;
+}
+
+void test_mask_pool() {
+    // Ring bounds: capacity rounded up to a power of 2, push fails when full
+    MaskRing ring(3);
+    EncryptionMask mask;
+    memset(&mask, 0, sizeof(mask));
+    assert (ring.capacity() == 4);
+    assert (!ring.pop(mask));
+    for (int i = 0; i < 4; i++)
+        assert (ring.push(mask));
+    assert (!ring.push(mask));
+    assert (ring.size() == 4);
+    assert (ring.pop(mask));
+    assert (ring.push(mask));
+
+    LHE25519 scheme;
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    scheme.key_gen();
+    scheme.start_mask_pool(16, 2);
+    for (int i = 0; i < 2000 && scheme.mask_pool_size() < 8; i++)
+        this_thread::sleep_for(chrono::milliseconds(5));
+    assert (scheme.mask_pool_size() > 0);
+
+    int64_t values[4] = {-98, 0, 12345, -(1 << 19)};
+    for (int i = 0; i < 4; i++) {
+        Ciphertext ct;
+        int64_t x;
+        scheme.encrypt(ct, values[i]);
+        scheme.decrypt(x, ct);
+        assert (x == values[i]);
+    }
+
+    // Both ends of the message range, brought back into the table by hom_add
+    int64_t max = (1LL << 39) - 1;
+    Ciphertext ct1, ct2, ct3;
+    int64_t x;
+    scheme.encrypt(ct1, max);
+    scheme.encrypt(ct2, 5 - max);
+    scheme.hom_add(ct3, ct1, ct2);
+    scheme.decrypt(x, ct3);
+    assert (x == 5);
+    scheme.encrypt(ct1, -max - 1);
+    scheme.encrypt(ct2, max - 6);
+    scheme.hom_add(ct3, ct1, ct2);
+    scheme.decrypt(x, ct3);
+    assert (x == -7);
+
+    // A new key drops the masks made for the old one
+    scheme.key_gen();
+    assert (scheme.mask_pool_size() == 0);
+    scheme.encrypt(ct1, 77);
+    scheme.decrypt(x, ct1);
+    assert (x == 77);
+
+    cout << "Test mask pool succeeds" << endl;
+}
+
 void test_hom_add() {
     LHE25519 scheme;
-    scheme.precompute_decrypt_table();
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
     scheme.key_gen();
 
     Ciphertext ct1, ct2;
@@ -51,9 +395,79 @@ void test_hom_add() {
     cout << "Test hom add succeeds" << endl;
 }
 
+void test_batch_ops() {
+    // 15 points: one 8-way and one 4-way batch where supported, then a scalar tail
+    const size_t n = 15;
+    ge_p3 p[n], q[n], r[n];
+    ge_cached q_cached[n];
+    ge_precomp q_precomp[n];
+    uint8_t scalar[32];
+    memset(scalar, 0, 32);
+    for (size_t i = 0; i < n; i++) {
+        scalar[0] = (uint8_t)(3 * i + 1);
+        scalar[5] = (uint8_t)(17 * i);
+        ge_scalarmult_base(&p[i], scalar);
+        scalar[9] = (uint8_t)(i + 100);
+        ge_scalarmult_base(&q[i], scalar);
+        ge_p3_to_cached(&q_cached[i], &q[i]);
+        q_precomp[i] = k25519Precomp[i / 8][i % 8];
+    }
+
+    for (int op = 0; op < 5; op++) {
+        if (op == 0) ge_add_batch(r, p, q_cached, n);
+        if (op == 1) ge_sub_batch(r, p, q_cached, n);
+        if (op == 2) ge_madd_batch(r, p, q_precomp, n);
+        if (op == 3) ge_msub_batch(r, p, q_precomp, n);
+        if (op == 4) ge_dbl_batch(r, p, n);
+
+        for (size_t i = 0; i < n; i++) {
+            ge_p1p1 t;
+            ge_p3 expected;
+            if (op == 0) ge_add(&t, &p[i], &q_cached[i]);
+            if (op == 1) ge_sub(&t, &p[i], &q_cached[i]);
+            if (op == 2) ge_madd(&t, &p[i], &q_precomp[i]);
+            if (op == 3) ge_msub(&t, &p[i], &q_precomp[i]);
+            if (op == 4) ge_p3_dbl(&t, &p[i]);
+            ge_p1p1_to_p3(&expected, &t);
+
+            uint8_t b1[32], b2[32];
+            ge_p3_tobytes(b1, &r[i]);
+            ge_p3_tobytes(b2, &expected);
+            assert (memcmp(b1, b2, 32) == 0);
+        }
+    }
+
+    LHE25519 scheme;
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    scheme.key_gen();
+
+    Ciphertext a[n], b[n], c[n];
+    for (size_t i = 0; i < n; i++) {
+        scheme.encrypt(a[i], (int64_t)i * 11 - 30);
+        scheme.encrypt(b[i], (int64_t)i * 7);
+    }
+    scheme.hom_add(c, a, b, n);
+    for (size_t i = 0; i < n; i++) {
+        int64_t x;
+        scheme.decrypt(x, c[i]);
+        assert (x == (int64_t)i * 18 - 30);
+    }
+
+    const char* backend = "scalar";
+#ifdef GE_BATCH_AVX2
+    if (ge_avx2)
+        backend = "avx2";
+#endif
+#ifdef GE_BATCH_IFMA
+    if (ge_ifma)
+        backend = "ifma";
+#endif
+    cout << "Test batch ops succeeds (" << backend << ")" << endl;
+}
+
 void test_hom_add_plain() {
     LHE25519 scheme;
-    scheme.precompute_decrypt_table();
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
     scheme.key_gen();
 
     Ciphertext ct1, ct_result;
@@ -74,7 +488,7 @@ void test_hom_add_plain() {
 
 void test_hom_mul() {
     LHE25519 scheme;
-    scheme.precompute_decrypt_table();
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
     scheme.key_gen();
 
     Ciphertext ct1, ct_result;
@@ -93,9 +507,157 @@ void test_hom_mul() {
     cout << "Test hom mul succeeds" << endl; 
 }
 
+void test_hom_inner_product() {
+    LHE25519 scheme;
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    scheme.key_gen();
+
+    // Straus below GE_MSM_STRAUS_MAX, Pippenger above
+    const size_t sizes[] = {0, 1, 7, GE_MSM_STRAUS_MAX + 1, 300};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        std::vector<Ciphertext> cts(n);
+        std::vector<Plaintext> weights(n);
+        int64_t expected = 0;
+        for (size_t i = 0; i < n; i++) {
+            int64_t x = (int64_t)(i % 13) - 6;
+            int64_t w = (int64_t)(i * 7919 % 41) - 20;
+            scheme.encrypt(cts[i], x);
+            scheme.encode(weights[i], w);
+            expected += x * w;
+        }
+
+        Ciphertext result;
+        scheme.hom_inner_product(result, cts.data(), weights.data(), n);
+        int64_t r;
+        scheme.decrypt(r, result);
+        assert (r == expected);
+
+        // Same points as hom_mul and hom_add in a loop
+        if (n > 0) {
+            Ciphertext loop, term;
+            scheme.hom_mul(loop, cts[0], weights[0]);
+            for (size_t i = 1; i < n; i++) {
+                scheme.hom_mul(term, cts[i], weights[i]);
+                scheme.hom_add(loop, loop, term);
+            }
+            uint8_t b1[32], b2[32];
+            ge_p3_tobytes(b1, &result.c0);
+            ge_p3_tobytes(b2, &loop.c0);
+            assert (memcmp(b1, b2, 32) == 0);
+            ge_p3_tobytes(b1, &result.c1);
+            ge_p3_tobytes(b2, &loop.c1);
+            assert (memcmp(b1, b2, 32) == 0);
+        }
+    }
+
+    cout << "Test hom inner product succeeds" << endl;
+}
+
+// Same ciphertext points, compressed
+static bool same_ciphertext(const Ciphertext& a, const Ciphertext& b) {
+    uint8_t b1[32], b2[32], b3[32], b4[32];
+    ge_p3_tobytes(b1, &a.c0);
+    ge_p3_tobytes(b2, &b.c0);
+    ge_p3_tobytes(b3, &a.c1);
+    ge_p3_tobytes(b4, &b.c1);
+    return memcmp(b1, b2, 32) == 0 && memcmp(b3, b4, 32) == 0;
+}
+
+// plain.m + L: the same scalar mod L, too long for the short paths
+static void add_group_order(Plaintext& full, const Plaintext& plain) {
+    static const uint8_t L[32] = {
+        0xED, 0xD3, 0xF5, 0x5C, 0x1A, 0x63, 0x12, 0x58,
+        0xD6, 0x9C, 0xF7, 0xA2, 0xDE, 0xF9, 0xDE, 0x14,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+    };
+    int carry = 0;
+    for (int i = 0; i < 32; i++) {
+        int sum = plain.m[i] + L[i] + carry;
+        full.m[i] = (uint8_t)sum;
+        carry = sum >> 8;
+    }
+}
+
+void test_short_plaintexts() {
+    LHE25519 scheme;
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    scheme.key_gen();
+
+    Ciphertext ct;
+    scheme.encrypt(ct, -7);
+
+    // The short paths against the full scalars of the same plaintexts
+    const int64_t values[] = {0, 1, -1, 2, -3, 37, -5, 255, -256, 65535, -65536,
+                              (1L << 39) - 1, -(1L << 39)};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        Plaintext plain, full;
+        scheme.encode(plain, values[i]);
+        add_group_order(full, plain);
+
+        Ciphertext fast, slow;
+        scheme.hom_mul(fast, ct, plain);
+        scheme.hom_mul(slow, ct, full);
+        assert (same_ciphertext(fast, slow));
+
+        scheme.hom_add_plain(fast, ct, plain);
+        scheme.hom_add_plain(slow, ct, full);
+        assert (same_ciphertext(fast, slow));
+
+        scheme.hom_sub_plain(fast, ct, plain);
+        scheme.hom_sub_plain(slow, ct, full);
+        assert (same_ciphertext(fast, slow));
+
+        // In place
+        fast = ct;
+        scheme.hom_mul(fast, fast, plain);
+        scheme.hom_mul(slow, ct, full);
+        assert (same_ciphertext(fast, slow));
+    }
+
+    // A plaintext not made by encode, m = 2^62, is short all the same
+    Plaintext big, big_full;
+    big.m[7] = 0x40;
+    add_group_order(big_full, big);
+    Ciphertext fast, slow;
+    scheme.hom_mul(fast, ct, big);
+    scheme.hom_mul(slow, ct, big_full);
+    assert (same_ciphertext(fast, slow));
+
+    // A copy of the scalar alone decrypts the same
+    Plaintext weight, copy;
+    scheme.encode(weight, -3);
+    memcpy(copy.m, weight.m, 32);
+    Ciphertext result;
+    scheme.hom_mul(result, ct, copy);
+    int64_t r;
+    scheme.decrypt(r, result);
+    assert (r == 21);
+
+    // Inner products over short and full weights, Straus and Pippenger
+    const size_t sizes[] = {10, GE_MSM_STRAUS_MAX + 50};
+    for (size_t s = 0; s < 2; s++) {
+        size_t n = sizes[s];
+        std::vector<Ciphertext> cts(n);
+        std::vector<Plaintext> weights(n), full(n);
+        for (size_t i = 0; i < n; i++) {
+            scheme.encrypt(cts[i], (int64_t)i);
+            scheme.encode(weights[i], (int64_t)(i * 613 % 1000) - 500);
+            add_group_order(full[i], weights[i]);
+        }
+        Ciphertext fast, slow;
+        scheme.hom_inner_product(fast, cts.data(), weights.data(), n);
+        scheme.hom_inner_product(slow, cts.data(), full.data(), n);
+        assert (same_ciphertext(fast, slow));
+    }
+
+    cout << "Test short plaintexts succeeds" << endl;
+}
+
 void test_hom_negate() {
     LHE25519 scheme;
-    scheme.precompute_decrypt_table();
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
     scheme.key_gen();
 
     Ciphertext ct1, ct_result;
@@ -113,9 +675,119 @@ void test_hom_negate() {
     cout << "Test hom negate succeeds" << endl;
 }
 
+void test_hom_constants() {
+    LHE25519 scheme;
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    scheme.key_gen();
+
+    Ciphertext ct, fast, slow;
+    scheme.encrypt(ct, 11);
+
+    // Addition chains and negations against full scalars mod L
+    const int64_t constants[] = {0, 1, -1, 2, -2, 3, 7, 10, -10, 100, 1000, -12345};
+    for (size_t i = 0; i < sizeof(constants) / sizeof(constants[0]); i++) {
+        Plaintext plain, full;
+        scheme.encode(plain, constants[i]);
+        add_group_order(full, plain);
+        scheme.hom_mul(slow, ct, full);
+
+        scheme.hom_mul(fast, ct, constants[i]);
+        assert (same_ciphertext(fast, slow));
+
+        if (constants[i] == -1) {
+            scheme.hom_negate(fast, ct);
+            assert (same_ciphertext(fast, slow));
+            fast = ct;
+            scheme.hom_negate(fast, fast);
+            assert (same_ciphertext(fast, slow));
+        }
+        if (constants[i] == 2) {
+            scheme.hom_double(fast, ct);
+            assert (same_ciphertext(fast, slow));
+        }
+
+        int64_t r;
+        scheme.decrypt(r, fast);
+        assert (r == 11 * constants[i]);
+    }
+
+    cout << "Test hom constants succeeds" << endl;
+}
+
+void test_search_block() {
+    LHE25519 scheme;
+    scheme.set_search_block(7);
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    scheme.key_gen();
+
+    Ciphertext ct1, ct2;
+    scheme.encrypt(ct1, -98);
+    scheme.encrypt(ct2, 46);
+
+    int64_t x1, x2;
+    scheme.set_search_block(1);
+    scheme.decrypt(x1, ct1);
+    scheme.set_search_block(256);
+    scheme.decrypt(x2, ct2);
+    assert (x1 == -98);
+    assert (x2 == 46);
+
+    // Hits on the first and last baby steps, the last block being partial with 7
+    int64_t messages[4] = {0, (1 << TEST_BABY_BITS) - 1, -(1 << 19), (1 << 19) - 1};
+    int blocks[3] = {1, 7, 256};
+    for (int i = 0; i < 4; i++) {
+        Ciphertext ct;
+        scheme.encrypt(ct, messages[i]);
+        for (int b = 0; b < 3; b++) {
+            int64_t x;
+            scheme.set_search_block(blocks[b]);
+            scheme.decrypt(x, ct);
+            assert (x == messages[i]);
+        }
+    }
+
+    cout << "Test search block succeeds" << endl;
+}
+
+void test_decrypt_batch() {
+    LHE25519 scheme;
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    scheme.key_gen();
+
+    int64_t messages[5] = {-98, 46, 0, -(1 << 19), (1 << 19) - 1};
+    Ciphertext cts[5];
+    for (int i = 0; i < 5; i++)
+        scheme.encrypt(cts[i], messages[i]);
+
+    int64_t results[5];
+    scheme.decrypt_batch(results, cts, 5);
+    for (int i = 0; i < 5; i++)
+        assert (results[i] == messages[i]);
+
+    cout << "Test decrypt batch succeeds" << endl;
+}
+
+void test_decrypt_parallel() {
+    LHE25519 scheme;
+    scheme.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    scheme.key_gen();
+
+    int64_t messages[4] = {-98, 46, -(1 << 19), (1 << 19) - 1};
+    for (int i = 0; i < 4; i++) {
+        Ciphertext ct;
+        scheme.encrypt(ct, messages[i]);
+
+        int64_t x;
+        scheme.decrypt(x, ct, 3);
+        assert (x == messages[i]);
+    }
+
+    cout << "Test decrypt parallel succeeds" << endl;
+}
+
 void test_save_load_table() {
     LHE25519 scheme1, scheme2;
-    scheme1.precompute_decrypt_table();
+    scheme1.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
 
     ofstream ofs("decrypt_table.dat", ofstream::out|ofstream::binary);
     scheme1.save_table(ofs);
@@ -144,6 +816,498 @@ void test_save_load_table() {
     cout << "Test encryption and decryption succeeds" << endl;
 }
 
+void test_full_lookup_table() {
+    // Every slot taken, as in a corrupted table file: probes stop after one lap
+    LookupTable table;
+    LookupBucket* buckets = table.assign_raw(4, 0);
+    for (int b = 0; b < 4; b++)
+        for (int i = 0; i < LOOKUP_SLOTS_PER_BUCKET; i++)
+            buckets[b].slots[i] = {0xFFFFFFFFu, b};
+
+    uint8_t key[32] = {1, 2, 3, 4, 5, 6, 7, 8};
+    int visits = 0;
+    assert (!table.find(key, [&](int32_t) { visits++; return false; }));
+    assert (visits == 0);
+
+    bool thrown = false;
+    try {
+        table.insert(key, 1);
+    } catch (const length_error&) {
+        thrown = true;
+    }
+    assert (thrown);
+
+    cout << "Test full lookup table succeeds" << endl;
+}
+
+static bool load_fails(const string& bytes) {
+    DecryptionTable table;
+    stringstream stream(bytes);
+    try {
+        table.load(stream);
+    } catch (const runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void test_corrupted_table_header() {
+    LHE25519 scheme;
+    scheme.precompute_decrypt_table(16, 6);
+    stringstream file;
+    scheme.save_table(file);
+    const string bytes = file.str();
+    assert (!load_fails(bytes));
+
+    // More buckets than the split needs, or entries than it has giant steps
+    TableHeader header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    string more_buckets = bytes, more_entries = bytes;
+    header.num_buckets *= 1000;
+    memcpy(&more_buckets[0], &header, sizeof(header));
+    memcpy(&header, bytes.data(), sizeof(header));
+    header.num_entries = header.num_buckets * LOOKUP_SLOTS_PER_BUCKET;
+    memcpy(&more_entries[0], &header, sizeof(header));
+    assert (load_fails(more_buckets));
+    assert (load_fails(more_entries));
+
+    // Missing buckets are noticed before allocating for them
+    assert (load_fails(bytes.substr(0, bytes.size() / 2)));
+
+    // Failed loads, of either format, leave the table as it was
+    DecryptionTable table;
+    stringstream good(bytes);
+    table.load(good);
+    size_t entries = table.lookup().size();
+    uint64_t count = 3;
+    string legacy((const char*)&count, sizeof(count));
+    legacy += string(36, 'x');
+    string bad_checksum = bytes;
+    bad_checksum[bytes.size() - 1] ^= 1;
+    const string failing[] = {"", "abc", legacy, bad_checksum, bytes.substr(0, bytes.size() - 1)};
+    for (const string& f : failing) {
+        stringstream stream(f);
+        bool thrown = false;
+        try {
+            table.load(stream);
+        } catch (const runtime_error&) {
+            thrown = true;
+        }
+        assert (thrown);
+        assert (table.msg_bits() == 16 && table.baby_bits() == 6);
+        assert (table.lookup().size() == entries);
+    }
+
+    ofstream ofs("test_table.dat", ofstream::out|ofstream::binary);
+    ofs.write(more_entries.data(), more_entries.size());
+    ofs.close();
+    bool thrown = false;
+    try {
+        scheme.map_table("test_table.dat");
+    } catch (const runtime_error&) {
+        thrown = true;
+    }
+    assert (thrown);
+    remove("test_table.dat");
+
+    cout << "Test corrupted table header succeeds" << endl;
+}
+
+void test_map_table() {
+    LHE25519 scheme1, scheme2;
+    scheme1.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+
+    ofstream ofs("test_table.dat", ofstream::out|ofstream::binary);
+    scheme1.save_table(ofs);
+    ofs.close();
+
+    scheme2.map_table("test_table.dat", true);
+    scheme2.key_gen();
+
+    Ciphertext ct1, ct2;
+    scheme2.encrypt(ct1, -98);
+    scheme2.encrypt(ct2, 46);
+
+    int64_t x1, x2;
+    scheme2.decrypt(x1, ct1);
+    scheme2.decrypt(x2, ct2);
+    assert (x1 == -98);
+    assert (x2 == 46);
+
+    remove("test_table.dat");
+
+    cout << "Test map table succeeds" << endl;
+}
+
+void test_table_registry() {
+    // A split no other test uses, so that its segment is ours
+    const int msg_bits = 18, baby_bits = 7;
+    TableRegistry& registry = TableRegistry::instance();
+    registry.remove(msg_bits, baby_bits);
+    assert (!registry.attach(msg_bits, baby_bits));
+
+    LHE25519 builder;
+    builder.precompute_decrypt_table(msg_bits, baby_bits);
+    stringstream file;
+    builder.save_table(file);
+
+    LHE25519 scheme1, scheme2;
+    scheme1.key_gen();
+    scheme2.key_gen();
+    scheme1.load_shared_table(file);
+    file.seekg(0);
+    scheme2.load_shared_table(file);
+    assert (scheme1.shared_decrypt_table() == scheme2.shared_decrypt_table());
+    assert (scheme1.decrypt_table().lookup().size() == builder.decrypt_table().lookup().size());
+
+    // Another process attaches to the same segment
+    Ciphertext ct;
+    scheme1.encrypt(ct, -(1 << 16) + 3);
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Drop the copies inherited from the parent, so the child maps the segment itself
+        LHE25519 child(scheme1.public_key(), scheme1.secret_key());
+        scheme1.set_decrypt_table(std::make_shared<DecryptionTable>());
+        scheme2.set_decrypt_table(std::make_shared<DecryptionTable>());
+        std::shared_ptr<const DecryptionTable> table = TableRegistry::instance().attach(msg_bits, baby_bits);
+        if (!table)
+            _exit(1);
+        child.set_decrypt_table(table);
+        int64_t x;
+        child.decrypt(x, ct);
+        _exit(x == -(1 << 16) + 3 ? 0 : 2);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert (WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    int64_t x;
+    scheme2.encrypt(ct, 12345);
+    scheme2.decrypt(x, ct);
+    assert (x == 12345);
+
+    // The segment is private to its owner
+    int fd = shm_open(TableRegistry::segment_name(msg_bits, baby_bits, false).c_str(), O_RDONLY, 0);
+    assert (fd >= 0);
+    struct stat st;
+    assert (fstat(fd, &st) == 0);
+    close(fd);
+    assert ((st.st_mode & 0777) == 0600 && st.st_uid == geteuid());
+
+    // A file whose header disagrees with the segment is not served from
+    // it, whether this process holds the table already or attaches anew
+    string other = file.str();
+    other[offsetof(TableHeader, checksum)] ^= 1;
+    bool thrown = false;
+    for (int held = 1; held >= 0; held--) {
+        if (!held) {
+            scheme1.set_decrypt_table(std::make_shared<DecryptionTable>());
+            scheme2.set_decrypt_table(std::make_shared<DecryptionTable>());
+        }
+        stringstream mismatched(other);
+        thrown = false;
+        try {
+            registry.load(mismatched);
+        } catch (const runtime_error&) {
+            thrown = true;
+        }
+        assert (thrown);
+    }
+    file.seekg(0);
+    assert (registry.load(file)->lookup().size() == builder.decrypt_table().lookup().size());
+
+    // A corrupted file never makes it into a segment
+    registry.remove(msg_bits, baby_bits);
+    string bytes = file.str();
+    bytes[bytes.size() - 5] ^= 1;
+    stringstream corrupted(bytes);
+    thrown = false;
+    try {
+        registry.load(corrupted);
+    } catch (const runtime_error&) {
+        thrown = true;
+    }
+    assert (thrown);
+    assert (!registry.attach(msg_bits, baby_bits));
+
+    cout << "Test table registry succeeds" << endl;
+}
+
+void test_table_placement() {
+    LHE25519 reference;
+    reference.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    reference.key_gen();
+    const LookupTable& expected = reference.decrypt_table().lookup();
+    size_t bytes = expected.bucket_count() * sizeof(LookupBucket);
+
+    ofstream ofs("test_table.dat", ofstream::out|ofstream::binary);
+    reference.save_table(ofs);
+    ofs.close();
+
+    // Huge pages fall back to smaller ones when none are reserved
+    TablePages pages[4] = {TablePages::Default, TablePages::Transparent,
+                           TablePages::Huge2MB, TablePages::Huge1GB};
+    for (int i = 0; i < 4; i++) {
+        TablePlacement placement;
+        placement.pages = pages[i];
+        placement.prefault = i % 2 == 1;
+        placement.numa_replicas = i >= 2;
+
+        LHE25519 built, loaded, mapped;
+        built.set_table_placement(placement);
+        built.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+        loaded.set_table_placement(placement);
+        ifstream ifs("test_table.dat", ifstream::in|ifstream::binary);
+        loaded.load_table(ifs);
+        ifs.close();
+        mapped.set_table_placement(placement);
+        mapped.map_table("test_table.dat");
+
+        LHE25519* schemes[3] = {&built, &loaded, &mapped};
+        for (int j = 0; j < 3; j++) {
+            const DecryptionTable& table = schemes[j]->decrypt_table();
+            assert (table.placement().pages == pages[i]);
+            assert (table.replica_count() <= (size_t)numa_node_count());
+            assert (table.lookup().bucket_count() == expected.bucket_count());
+            assert (memcmp(table.lookup().buckets(), expected.buckets(), bytes) == 0);
+
+            LHE25519 scheme(reference.public_key(), reference.secret_key());
+            scheme.set_decrypt_table(schemes[j]->shared_decrypt_table());
+            Ciphertext ct;
+            int64_t x;
+            scheme.encrypt(ct, -(1 << 19) + 7);
+            scheme.decrypt(x, ct);
+            assert (x == -(1 << 19) + 7);
+        }
+    }
+
+    // A replica copies the buckets even of a table that only views them
+    LookupTable copy;
+    copy.set_memory(TablePages::Transparent, 0);
+    copy.copy_buckets(expected);
+    assert (copy.owned() && copy.size() == expected.size());
+    assert (memcmp(copy.buckets(), expected.buckets(), bytes) == 0);
+
+    remove("test_table.dat");
+
+    cout << "Test table placement succeeds" << endl;
+}
+
+void test_precompute_threads() {
+    // The table, as saved, must not depend on the number of threads building it
+    LHE25519 scheme1, scheme2;
+    scheme1.precompute_decrypt_table(16, 6, 1);
+    scheme2.precompute_decrypt_table(16, 6, 5);
+
+    stringstream file1, file2;
+    scheme1.save_table(file1);
+    scheme2.save_table(file2);
+    assert (file1.str() == file2.str());
+
+    cout << "Test precompute threads succeeds" << endl;
+}
+
+void test_bit_split() {
+    LHE25519 scheme1, scheme2;
+    scheme1.precompute_decrypt_table(16, 6);
+    scheme1.key_gen();
+
+    ofstream ofs("test_table.dat", ofstream::out|ofstream::binary);
+    scheme1.save_table(ofs);
+    ofs.close();
+
+    LHE25519 scheme3(scheme1.public_key(), scheme1.secret_key());
+    scheme3.map_table("test_table.dat");
+    assert (scheme3.decrypt_table().msg_bits() == 16);
+    assert (scheme3.decrypt_table().baby_bits() == 6);
+
+    Ciphertext ct1, ct2;
+    scheme1.encrypt(ct1, -(1 << 15));
+    scheme1.encrypt(ct2, (1 << 15) - 1);
+
+    int64_t x1, x2;
+    scheme3.decrypt(x1, ct1);
+    scheme3.decrypt(x2, ct2);
+    assert (x1 == -(1 << 15));
+    assert (x2 == (1 << 15) - 1);
+
+    remove("test_table.dat");
+
+    bool thrown = false;
+    try {
+        scheme2.precompute_decrypt_table(20, 20);
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    assert (thrown);
+
+    cout << "Test bit split succeeds" << endl;
+}
+
+void test_shared_table() {
+    LHE25519 owner;
+    owner.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS);
+    std::shared_ptr<const DecryptionTable> table = owner.shared_decrypt_table();
+
+    // Instances with their own keys on one copy of the table
+    const int num_schemes = 4;
+    std::vector<LHE25519> schemes(num_schemes);
+    for (int i = 0; i < num_schemes; i++) {
+        schemes[i].key_gen();
+        schemes[i].set_decrypt_table(table);
+        assert (&schemes[i].decrypt_table() == table.get());
+    }
+    LHE25519 copy = schemes[0];
+    assert (&copy.decrypt_table() == table.get());
+
+    // Concurrent decryptions, several of them through the same const instance
+    const int per_thread = 20;
+    std::vector<std::vector<Ciphertext>> cts(2 * num_schemes, std::vector<Ciphertext>(per_thread));
+    for (int t = 0; t < 2 * num_schemes; t++) {
+        for (int i = 0; i < per_thread; i++)
+            schemes[t % num_schemes].encrypt(cts[t][i], (int64_t)(t * 1000 + i) - 3000);
+    }
+    std::atomic<int> failures(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 2 * num_schemes; t++) {
+        workers.emplace_back([&, t]() {
+            const LHE25519& scheme = schemes[t % num_schemes];
+            for (int i = 0; i < per_thread; i++) {
+                int64_t x;
+                scheme.decrypt(x, cts[t][i]);
+                if (x != (int64_t)(t * 1000 + i) - 3000)
+                    failures++;
+            }
+        });
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    assert (failures == 0);
+
+    // Building another table leaves the shared one to the others
+    owner.precompute_decrypt_table(16, 6);
+    assert (owner.decrypt_table().msg_bits() == 16);
+    assert (table->msg_bits() == TEST_MSG_BITS);
+    assert (table.use_count() == num_schemes + 2);
+
+    bool thrown = false;
+    try {
+        schemes[0].set_decrypt_table(nullptr);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert (thrown);
+
+    cout << "Test shared table succeeds" << endl;
+}
+
+void test_symmetric_table() {
+    LHE25519 scheme1;
+    scheme1.precompute_decrypt_table(TEST_MSG_BITS, TEST_BABY_BITS, 0, true);
+    scheme1.key_gen();
+    assert (scheme1.decrypt_table().lookup().size() == (1 << (TEST_MSG_BITS - TEST_BABY_BITS - 1)) + 1);
+
+    ofstream ofs("test_table.dat", ofstream::out|ofstream::binary);
+    scheme1.save_table(ofs);
+    ofs.close();
+
+    LHE25519 scheme2(scheme1.public_key(), scheme1.secret_key());
+    scheme2.map_table("test_table.dat", true);
+    assert (scheme2.decrypt_table().symmetric());
+
+    int64_t m[6] = {-(1 << 19), -(1 << 10) - 1, -98, 0, 46, (1 << 19) - 1};
+    Ciphertext cts[6];
+    for (int i = 0; i < 6; i++)
+        scheme1.encrypt(cts[i], m[i]);
+
+    for (int i = 0; i < 6; i++) {
+        int64_t x;
+        scheme2.decrypt(x, cts[i]);
+        assert (x == m[i]);
+    }
+
+    int64_t xs[6];
+    scheme1.decrypt_batch(xs, cts, 6);
+    for (int i = 0; i < 6; i++)
+        assert (xs[i] == m[i]);
+
+    remove("test_table.dat");
+
+    cout << "Test symmetric table succeeds" << endl;
+}
+
+void test_kangaroo() {
+    LHE25519 scheme1;
+    scheme1.precompute_kangaroo_table(24, 256);
+    scheme1.set_decrypt_solver(DecryptSolver::Kangaroo);
+    scheme1.key_gen();
+
+    ofstream ofs("test_kangaroo.dat", ofstream::out|ofstream::binary);
+    scheme1.save_kangaroo_table(ofs);
+    ofs.close();
+
+    LHE25519 scheme2(scheme1.public_key(), scheme1.secret_key());
+    ifstream ifs("test_kangaroo.dat", ifstream::in|ifstream::binary);
+    scheme2.load_kangaroo_table(ifs);
+    ifs.close();
+    remove("test_kangaroo.dat");
+    scheme2.set_decrypt_solver(DecryptSolver::Kangaroo);
+    assert (scheme2.kangaroo_table().msg_bits() == 24);
+    assert (scheme2.kangaroo_table().size() == scheme1.kangaroo_table().size());
+
+    int64_t m[4] = {-(1 << 23), -98, 46, (1 << 23) - 1};
+    Ciphertext cts[4];
+    for (int i = 0; i < 4; i++)
+        scheme1.encrypt(cts[i], m[i]);
+
+    int64_t x1, x2;
+    scheme1.decrypt(x1, cts[1]);
+    scheme2.decrypt(x2, cts[2], 2);
+    assert (x1 == -98);
+    assert (x2 == 46);
+
+    int64_t xs[4];
+    scheme2.decrypt_batch(xs, cts, 4);
+    for (int i = 0; i < 4; i++)
+        assert (xs[i] == m[i]);
+
+    // Entries out of order, or fewer than the header says, are rejected
+    stringstream file;
+    scheme1.save_kangaroo_table(file);
+    string bytes = file.str();
+    string unsorted = bytes, truncated = bytes.substr(0, bytes.size() - 1);
+    memcpy(&unsorted[sizeof(KangarooHeader)], &bytes[bytes.size() - sizeof(KangarooEntry)],
+           sizeof(KangarooEntry));
+    string files[2] = {unsorted, truncated};
+    for (int i = 0; i < 2; i++) {
+        KangarooTable table;
+        stringstream stream(files[i]);
+        bool thrown = false;
+        try {
+            table.load(stream);
+        } catch (const runtime_error&) {
+            thrown = true;
+        }
+        assert (thrown);
+    }
+
+    // Walks that cannot succeed (no logarithm in the table checks out) fall back to the table
+    string useless = bytes;
+    for (size_t at = sizeof(KangarooHeader); at < useless.size(); at += sizeof(KangarooEntry))
+        useless[at + offsetof(KangarooEntry, log)] ^= 1;
+    stringstream useless_file(useless);
+    LHE25519 scheme3(scheme1.public_key(), scheme1.secret_key());
+    scheme3.load_kangaroo_table(useless_file);
+    scheme3.set_decrypt_solver(DecryptSolver::Kangaroo);
+    scheme3.precompute_decrypt_table(24, 12);
+    scheme3.decrypt(x1, cts[1]);
+    assert (x1 == -98);
+    scheme3.decrypt_batch(xs, cts, 2);
+    assert (xs[0] == m[0] && xs[1] == m[1]);
+
+    cout << "Test kangaroo decryption succeeds" << endl;
+}
+
 void test_large_msg() {
     LHE25519 scheme;
 
@@ -186,10 +1350,33 @@ void test_large_msg() {
 }
 
 int main() {
+    test_base_point();
+    test_field_backends();
+    test_invert();
+    test_random_source();
     test_enc_dec(); 
+    test_prepared_public_key();
+    test_mask_pool();
     test_hom_add();
+    test_batch_ops();
     test_hom_mul();
+    test_hom_inner_product();
+    test_short_plaintexts();
     test_hom_add_plain();
     test_hom_negate();
+    test_hom_constants();
+    test_search_block();
+    test_decrypt_batch();
+    test_decrypt_parallel();
+    test_full_lookup_table();
+    test_corrupted_table_header();
+    test_map_table();
+    test_table_registry();
+    test_table_placement();
+    test_precompute_threads();
+    test_bit_split();
+    test_symmetric_table();
+    test_shared_table();
+    test_kangaroo();
     return 0;
 }
@@ -0,0 +1,295 @@
+/*
+ * Copyright 2019 Zhicong Huang (zhicong303@gmail.com). All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution.
+ */
+
+#ifndef LOOKUP_TABLE_H
+#define LOOKUP_TABLE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include "table_memory.h"
+
+/*
+ * One table entry: a 32-bit fingerprint of the compressed point and the
+ * giant-step index stored for it. A zero tag marks an empty slot.
+ */
+struct LookupSlot {
+    uint32_t tag;
+    int32_t value;
+};
+
+#define LOOKUP_SLOTS_PER_BUCKET 8
+
+/* A bucket fills exactly one 64-byte cache line. */
+struct alignas(64) LookupBucket {
+    LookupSlot slots[LOOKUP_SLOTS_PER_BUCKET];
+};
+
+/*
+ * Open-addressing hash table from 32-byte compressed points to int32
+ * values, used as the giant-step table for decryption.
+ *
+ * Keys are not stored: each entry keeps only a 32-bit tag taken from the
+ * key, so a tag match is merely a candidate and the caller has to verify
+ * it against the full point. Compressed points are uniformly distributed,
+ * so the tag and the bucket index are read directly from disjoint key
+ * bytes instead of being hashed.
+ *
+ * A key is looked up in its home bucket first and, only if that bucket is
+ * full, in the following ones (linear probing over buckets). With the
+ * default load factor almost every probe touches a single cache line and
+ * performs no allocation.
+ *
+ * The capacity is fixed by reserve(); the table cannot be grown afterwards
+ * because the keys needed for rehashing are gone.
+ *
+ * Buckets are mapped anonymously, on the pages and NUMA node chosen with
+ * set_memory (see table_memory.h).
+ */
+class LookupTable {
+
+public:
+    LookupTable() {}
+
+    LookupTable(const LookupTable& other) {
+        operator=(other);
+    }
+
+    LookupTable& operator=(const LookupTable& other) {
+        if (this == &other)
+            return *this;
+
+        pages_ = other.pages_;
+        node_ = other.node_;
+        if (!other.owned_) {
+            view(other.buckets_, other.num_buckets_, other.size_);
+            return *this;
+        }
+
+        copy_buckets(other);
+        return *this;
+    }
+
+    ~LookupTable() {
+        release();
+    }
+
+    /*
+     * Drop all entries and make room for n entries.
+     */
+    void reserve(size_t n) {
+        allocate(buckets_for(n));
+    }
+
+    /* Number of buckets reserve(n) allocates */
+    static size_t buckets_for(size_t n) {
+        size_t slots = (size_t)(n / kMaxLoad) + 1;
+        return (slots + LOOKUP_SLOTS_PER_BUCKET - 1) / LOOKUP_SLOTS_PER_BUCKET;
+    }
+
+    /*
+     * Add an entry. Inserting the same key twice stores it twice.
+     */
+    void insert(const uint8_t key[32], int32_t value) {
+        if (!owned_)
+            throw std::logic_error("Cannot insert into a read-only lookup table");
+        if (size_ >= (size_t)(num_buckets_ * LOOKUP_SLOTS_PER_BUCKET * kMaxLoad))
+            throw std::length_error("Lookup table is full");
+
+        uint32_t tag = tag_of(key);
+        size_t b = bucket_of(key);
+        for (size_t probed = 0; probed < num_buckets_; probed++, b = next_bucket(b)) {
+            LookupSlot* slots = buckets_[b].slots;
+            for (int i = 0; i < LOOKUP_SLOTS_PER_BUCKET; i++) {
+                if (slots[i].tag != 0)
+                    continue;
+                slots[i].tag = tag;
+                slots[i].value = value;
+                size_++;
+                return;
+            }
+        }
+        throw std::length_error("Lookup table has no free slot");
+    }
+
+    /*
+     * Call visit(value) for every entry whose tag matches key, until visit
+     * returns true. Returns whether some visit returned true.
+     */
+    template <typename Visitor>
+    bool find(const uint8_t key[32], Visitor visit) const {
+        if (num_buckets_ == 0)
+            return false;
+
+        // A full (corrupted) table has no empty slot to stop at, so at most one lap
+        uint32_t tag = tag_of(key);
+        size_t b = bucket_of(key);
+        for (size_t probed = 0; probed < num_buckets_; probed++, b = next_bucket(b)) {
+            const LookupSlot* slots = buckets_[b].slots;
+            for (int i = 0; i < LOOKUP_SLOTS_PER_BUCKET; i++) {
+                if (slots[i].tag == 0)
+                    return false;
+                if (slots[i].tag == tag && visit(slots[i].value))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * Start loading the home bucket of key into the cache, so that a
+     * find issued some time later does not wait for memory.
+     */
+    void prefetch(const uint8_t key[32]) const {
+        if (num_buckets_ > 0)
+            __builtin_prefetch(&buckets_[bucket_of(key)], 0, 3);
+    }
+
+    void clear() {
+        allocate(0);
+    }
+
+    /*
+     * Pages and NUMA node (-1 for any) of the storage allocated from now
+     * on, by reserve, assign_raw or copy_buckets.
+     */
+    void set_memory(TablePages pages, int node = -1) {
+        pages_ = pages;
+        node_ = node;
+    }
+
+    /*
+     * Drop all entries and copy those of other into storage of this
+     * table, even when other only views its buckets.
+     */
+    void copy_buckets(const LookupTable& other) {
+        allocate(other.num_buckets_);
+        if (num_buckets_ > 0)
+            memcpy(buckets_, other.buckets_, num_buckets_ * sizeof(LookupBucket));
+        size_ = other.size_;
+    }
+
+    /*
+     * Move the pages of owned storage to NUMA node, and allocate there
+     * from now on.
+     */
+    void move_to_node(int node) {
+        node_ = node;
+        if (owned_ && buckets_ != nullptr)
+            table_memory_bind(buckets_, mapped_, node, true);
+    }
+
+    bool owned() const {
+        return owned_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    size_t bucket_count() const {
+        return num_buckets_;
+    }
+
+    const LookupBucket* buckets() const {
+        return buckets_;
+    }
+
+    /*
+     * Drop all entries and return zeroed storage for num_buckets buckets,
+     * to be filled with a bucket array previously obtained from buckets()
+     * that holds num_entries entries.
+     */
+    LookupBucket* assign_raw(size_t num_buckets, size_t num_entries) {
+        allocate(num_buckets);
+        size_ = num_entries;
+        return buckets_;
+    }
+
+    /*
+     * Drop all entries and probe an existing bucket array in place, e.g. one
+     * mapped from a table file. The memory is not copied, must stay valid
+     * while the table (or any copy of it) is used, and is never written.
+     */
+    void view(const LookupBucket* buckets, size_t num_buckets, size_t num_entries) {
+        release();
+        buckets_ = const_cast<LookupBucket*>(buckets);
+        num_buckets_ = num_buckets;
+        size_ = num_entries;
+        owned_ = false;
+    }
+
+    /* Exchange entries, storage and memory settings with other */
+    void swap(LookupTable& other) {
+        std::swap(buckets_, other.buckets_);
+        std::swap(num_buckets_, other.num_buckets_);
+        std::swap(size_, other.size_);
+        std::swap(owned_, other.owned_);
+        std::swap(pages_, other.pages_);
+        std::swap(node_, other.node_);
+        std::swap(mapped_, other.mapped_);
+    }
+
+    static uint32_t tag_of(const uint8_t key[32]) {
+        uint32_t tag = load_le32(key);
+        return tag == 0 ? 1 : tag;
+    }
+
+private:
+    /* Fraction of slots that may be occupied. */
+    static constexpr double kMaxLoad = 0.85;
+
+    static uint32_t load_le32(const uint8_t* in) {
+        return ((uint32_t)in[0]) | ((uint32_t)in[1] << 8) |
+               ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+    }
+
+    /* Map key bytes 4..7 onto [0, num_buckets_) without a division. */
+    size_t bucket_of(const uint8_t key[32]) const {
+        return (size_t)(((uint64_t)load_le32(key + 4) * num_buckets_) >> 32);
+    }
+
+    size_t next_bucket(size_t b) const {
+        return b + 1 == num_buckets_ ? 0 : b + 1;
+    }
+
+    void release() {
+        if (owned_)
+            table_memory_free(buckets_, mapped_);
+        buckets_ = nullptr;
+        mapped_ = 0;
+        num_buckets_ = 0;
+        size_ = 0;
+        owned_ = true;
+    }
+
+    void allocate(size_t num_buckets) {
+        release();
+        if (num_buckets == 0)
+            return;
+
+        // Page-aligned and zeroed by mmap
+        void* mem = table_memory_alloc(num_buckets * sizeof(LookupBucket), pages_, node_, &mapped_);
+        buckets_ = static_cast<LookupBucket*>(mem);
+        num_buckets_ = num_buckets;
+    }
+
+    LookupBucket* buckets_ = nullptr;
+    size_t num_buckets_ = 0;
+    size_t size_ = 0;
+    bool owned_ = true;
+
+    TablePages pages_ = TablePages::Default;
+    int node_ = -1;
+    size_t mapped_ = 0;
+};
+
+#endif // LOOKUP_TABLE_H
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2019 Zhicong Huang (zhicong303@gmail.com). All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution.
+ */
+
+#ifndef MASK_POOL_H
+#define MASK_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include "curve25519.h"
+
+/* How long a filling thread sleeps when it finds the pool full */
+#define MASK_POOL_IDLE_US 200
+
+/*
+ * The message-independent part of an encryption under public key PK:
+ * Enc(m) = (rPK + m*G, rG) for a fresh random r.
+ */
+struct EncryptionMask {
+    ge_p3 rPK;
+    ge_p3 rG;
+};
+
+/*
+ * Bounded lock-free ring of masks for any number of producers and
+ * consumers (D. Vyukov's MPMC queue): each slot carries a sequence number
+ * telling whether it is free for the push or ready for the pop with a
+ * given ticket, so pushes and pops only contend on their own counter.
+ */
+class MaskRing {
+
+public:
+    /* capacity is rounded up to a power of 2 */
+    explicit MaskRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots_.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++)
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        mask_ = size - 1;
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    /* Number of masks ready, only a snapshot while threads are running */
+    size_t size() const {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    /* false if the ring is full */
+    bool push(const EncryptionMask& mask) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots_[pos & mask_];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->mask = mask;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* false if the ring is empty */
+    bool pop(EncryptionMask& mask) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots_[pos & mask_];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        mask = slot->mask;
+        slot->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        EncryptionMask mask;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+
+    /* On their own cache lines, as producers and consumers run apart */
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+};
+
+/*
+ * Background threads keeping a MaskRing filled with masks made by
+ * make_mask, which must be safe to call from several threads at once.
+ * The threads stop and are joined when the pool is destroyed.
+ */
+class MaskPool {
+
+public:
+    typedef std::function<void(EncryptionMask&)> MaskFunction;
+
+    MaskPool(size_t capacity, int num_threads, const MaskFunction& make_mask)
+        : ring_(capacity), make_mask_(make_mask), stop_(false) {
+        if (capacity < 1 || num_threads < 1)
+            throw std::invalid_argument("Mask pool needs a positive capacity and thread count");
+        for (int t = 0; t < num_threads; t++)
+            workers_.push_back(std::thread([this]() { fill(); }));
+    }
+
+    ~MaskPool() {
+        stop_.store(true, std::memory_order_relaxed);
+        for (size_t t = 0; t < workers_.size(); t++)
+            workers_[t].join();
+    }
+
+    MaskPool(const MaskPool&) = delete;
+    MaskPool& operator=(const MaskPool&) = delete;
+
+    /* Take a mask, never waiting: false if none is ready */
+    bool pop(EncryptionMask& mask) {
+        return ring_.pop(mask);
+    }
+
+    size_t size() const {
+        return ring_.size();
+    }
+
+    size_t capacity() const {
+        return ring_.capacity();
+    }
+
+private:
+    void fill() {
+        EncryptionMask mask;
+        bool pending = false;
+        while (!stop_.load(std::memory_order_relaxed)) {
+            if (!pending) {
+                make_mask_(mask);
+                pending = true;
+            }
+            if (ring_.push(mask))
+                pending = false;
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(MASK_POOL_IDLE_US));
+        }
+    }
+
+    MaskRing ring_;
+    MaskFunction make_mask_;
+    std::atomic<bool> stop_;
+    std::vector<std::thread> workers_;
+};
+
+#endif // MASK_POOL_H
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2019 Zhicong Huang (zhicong303@gmail.com). All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution.
+ */
+
+#ifndef MSM_H
+#define MSM_H
+
+#include <vector>
+#include <algorithm>
+#include <stddef.h>
+#include "curve25519.h"
+#include "ge_batch.h"
+
+/*
+ * Multi-scalar multiplication r = a[0]*P[0] + ... + a[n-1]*P[n-1] in
+ * variable time, for the public scalars of encrypted inner products.
+ * a[i] is 32 bytes little-endian and below 2^bits, bits <= 255 (255 for
+ * any a[i][31] <= 127, as for ge_scalarmult_base).
+ *
+ * Up to GE_MSM_STRAUS_MAX points, Straus: each point gets a table of its
+ * odd multiples as in ge_double_scalarmult_vartime, and all of them share
+ * one chain of 256 doublings. Beyond, Pippenger: scalars are cut into
+ * signed c-bit digits, each window adds every point into one of 2^(c-1)
+ * buckets and sums the buckets with two additions each, so a point costs
+ * about 256/c mixed additions instead of a full scalar multiplication.
+ * Points going to distinct buckets are added with ge_madd_batch.
+ */
+
+/* Largest n for Straus, Pippenger is faster beyond (measured) */
+#define GE_MSM_STRAUS_MAX 128
+
+/* Straus on n points */
+static void ge_msm_straus(ge_p3 *r, const uint8_t *a, const ge_p3 *P, size_t n)
+{
+    std::vector<signed char> aslide(256 * n);
+    std::vector<ge_cached> Ai(8 * n); /* P,3P,5P,...,15P for each point */
+    ge_p1p1 t;
+    ge_p3 u;
+    ge_p3 P2;
+    size_t k;
+    int i, j;
+
+    for (k = 0; k < n; ++k) {
+        slide(&aslide[256 * k], a + 32 * k);
+
+        ge_p3_to_cached(&Ai[8 * k], &P[k]);
+        ge_p3_dbl(&t, &P[k]);
+        ge_p1p1_to_p3(&P2, &t);
+        for (j = 1; j < 8; ++j) {
+            ge_add(&t, &P2, &Ai[8 * k + j - 1]);
+            ge_p1p1_to_p3(&u, &t);
+            ge_p3_to_cached(&Ai[8 * k + j], &u);
+        }
+    }
+
+    ge_p3_0(r);
+
+    for (i = 255; i >= 0; --i) {
+        for (k = 0; k < n; ++k) {
+            if (aslide[256 * k + i]) {
+                break;
+            }
+        }
+        if (k < n) {
+            break;
+        }
+    }
+
+    for (; i >= 0; --i) {
+        ge_p3_dbl(&t, r);
+
+        for (k = 0; k < n; ++k) {
+            signed char d = aslide[256 * k + i];
+            if (d > 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_add(&t, &u, &Ai[8 * k + d / 2]);
+            } else if (d < 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_sub(&t, &u, &Ai[8 * k + (-d) / 2]);
+            }
+        }
+
+        ge_p1p1_to_p3(r, &t);
+    }
+}
+
+/*
+ * Window width minimizing the additions of Pippenger on n points of
+ * bits-bit scalars: (bits+c)/c windows of n bucket additions and 2^c to
+ * sum 2^(c-1) buckets.
+ */
+static int ge_msm_window(size_t n, int bits)
+{
+    int c, best = 1;
+    double cost, best_cost = 0;
+
+    for (c = 1; c <= 20; ++c) {
+        cost = (double)((bits + c) / c) * ((double)n + (double)(1 << c));
+        if (c == 1 || cost < best_cost) {
+            best = c;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+/*
+ * digits[w] for w < windows: a = sum of digits[w] * 2^(c*w), each digit in
+ * (-2^(c-1), 2^(c-1)]. With a < 2^bits and c*windows > bits, the last
+ * window absorbs the carry.
+ */
+static void ge_msm_digits(int32_t *digits, const uint8_t *a, int c, int windows)
+{
+    int32_t carry = 0;
+    int w, bit, b;
+
+    for (w = 0; w < windows; ++w) {
+        int32_t d = 0;
+        for (b = 0; b < c; ++b) {
+            bit = w * c + b;
+            if (bit < 256) {
+                d |= (int32_t)((a[bit >> 3] >> (bit & 7)) & 1) << b;
+            }
+        }
+        d += carry;
+        carry = d > (1 << (c - 1));
+        digits[w] = d - (carry << c);
+    }
+}
+
+/* bucket[lane[l]] = p[l] + q[l] for l < lanes, p[l] a copy of the bucket */
+static void ge_msm_add_lanes(ge_p3 *bucket, const size_t *lane, ge_p3 *p,
+                             const ge_precomp *q, size_t lanes)
+{
+    size_t l;
+
+    ge_madd_batch(p, p, q, lanes);
+    for (l = 0; l < lanes; ++l) {
+        bucket[lane[l]] = p[l];
+    }
+}
+
+/* Pippenger on n points */
+static void ge_msm_pippenger(ge_p3 *r, const uint8_t *a, const ge_p3 *P, size_t n,
+                             int bits)
+{
+    const int c = ge_msm_window(n, bits);
+    const int windows = (bits + c) / c;
+    const size_t buckets = (size_t)1 << (c - 1);
+    std::vector<ge_precomp> Q(n);
+    std::vector<int32_t> digits((size_t)windows * n);
+    std::vector<ge_p3> bucket(buckets);
+    std::vector<char> used(buckets);
+    size_t lane[GE_BATCH_WIDTH];
+    ge_p3 lp[GE_BATCH_WIDTH];
+    ge_precomp lq[GE_BATCH_WIDTH];
+    ge_p3 sum, acc;
+    ge_cached cached;
+    ge_p1p1 t;
+    size_t k, j, l, lanes;
+    int w, i;
+
+    {
+        std::vector<gfe> scratch(2 * n);
+        ge_p3_batch_to_precomp(Q.data(), P, scratch.data(), n);
+    }
+    for (k = 0; k < n; ++k) {
+        ge_msm_digits(&digits[(size_t)windows * k], a + 32 * k, c, windows);
+    }
+
+    ge_p3_0(r);
+
+    for (w = windows - 1; w >= 0; --w) {
+        for (i = 0; i < c; ++i) {
+            ge_p3_dbl(&t, r);
+            ge_p1p1_to_p3(r, &t);
+        }
+
+        /*
+         * bucket[j] = sum of the points whose digit is +-(j+1), added to
+         * up to GE_BATCH_WIDTH distinct buckets at a time
+         */
+        std::fill(used.begin(), used.end(), 0);
+        lanes = 0;
+        for (k = 0; k < n; ++k) {
+            int32_t d = digits[(size_t)windows * k + w];
+            if (d == 0) {
+                continue;
+            }
+            j = (size_t)(d > 0 ? d : -d) - 1;
+            if (!used[j]) {
+                ge_p3_0(&bucket[j]);
+                used[j] = 1;
+            }
+            for (l = 0; l < lanes && lane[l] != j; ++l) {
+            }
+            if (l < lanes) {
+                ge_msm_add_lanes(bucket.data(), lane, lp, lq, lanes);
+                lanes = 0;
+            }
+            lane[lanes] = j;
+            lp[lanes] = bucket[j];
+            if (d > 0) {
+                lq[lanes] = Q[k];
+            } else {
+                gfe_copy(lq[lanes].yplusx, Q[k].yminusx);
+                gfe_copy(lq[lanes].yminusx, Q[k].yplusx);
+                gfe_neg(lq[lanes].xy2d, Q[k].xy2d);
+            }
+            if (++lanes == GE_BATCH_WIDTH) {
+                ge_msm_add_lanes(bucket.data(), lane, lp, lq, lanes);
+                lanes = 0;
+            }
+        }
+        ge_msm_add_lanes(bucket.data(), lane, lp, lq, lanes);
+
+        /* acc = sum of (j+1)*bucket[j], as a running sum from the top */
+        ge_p3_0(&sum);
+        ge_p3_0(&acc);
+        for (j = buckets; j-- > 0; ) {
+            if (used[j]) {
+                ge_p3_to_cached(&cached, &bucket[j]);
+                ge_add(&t, &sum, &cached);
+                ge_p1p1_to_p3(&sum, &t);
+            }
+            ge_p3_to_cached(&cached, &sum);
+            ge_add(&t, &acc, &cached);
+            ge_p1p1_to_p3(&acc, &t);
+        }
+
+        ge_p3_to_cached(&cached, &acc);
+        ge_add(&t, r, &cached);
+        ge_p1p1_to_p3(r, &t);
+    }
+}
+
+/*
+ * r = a[0]*P[0] + ... + a[n-1]*P[n-1], a holding n scalars of 32 bytes,
+ * all below 2^bits. Straus skips leading zeros by itself, Pippenger needs
+ * bits to cut short scalars into fewer windows.
+ */
+static void ge_msm_vartime(ge_p3 *r, const uint8_t *a, const ge_p3 *P, size_t n,
+                           int bits)
+{
+    if (n <= GE_MSM_STRAUS_MAX) {
+        ge_msm_straus(r, a, P, n);
+    } else {
+        ge_msm_pippenger(r, a, P, n, bits);
+    }
+}
+
+#endif // MSM_H
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2019 Zhicong Huang (zhicong303@gmail.com). All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution.
+ */
+
+#ifndef RANDOM_SOURCE_H
+#define RANDOM_SOURCE_H
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include "curve25519.h"
+
+/* Keystream blocks generated per refill, the first half block rekeys */
+#define CHACHA20_DRBG_BLOCKS 8
+
+/*
+ * Where random_bytes draws from. Implementations used through
+ * set_random_source are called from every thread that encrypts or
+ * fills a mask pool, so they must be safe to call concurrently then
+ * (ChaCha20Drbg is).
+ */
+class RandomSource {
+
+public:
+    virtual ~RandomSource() {}
+
+    virtual void fill(void* data, size_t len) = 0;
+};
+
+/*
+ * out = ChaCha20 block (RFC 8439) for key, 32-bit counter and 96-bit nonce.
+ */
+static void chacha20_block(uint8_t out[64], const uint32_t key[8], uint32_t counter,
+                           const uint32_t nonce[3])
+{
+    uint32_t x[16], s[16];
+    int i;
+
+    s[0] = 0x61707865;
+    s[1] = 0x3320646e;
+    s[2] = 0x79622d32;
+    s[3] = 0x6b206574;
+    for (i = 0; i < 8; i++)
+        s[4 + i] = key[i];
+    s[12] = counter;
+    s[13] = nonce[0];
+    s[14] = nonce[1];
+    s[15] = nonce[2];
+    memcpy(x, s, sizeof(x));
+
+#define CHACHA20_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define CHACHA20_QR(a, b, c, d)                                 \
+    x[a] += x[b]; x[d] ^= x[a]; x[d] = CHACHA20_ROTL(x[d], 16); \
+    x[c] += x[d]; x[b] ^= x[c]; x[b] = CHACHA20_ROTL(x[b], 12); \
+    x[a] += x[b]; x[d] ^= x[a]; x[d] = CHACHA20_ROTL(x[d], 8);  \
+    x[c] += x[d]; x[b] ^= x[c]; x[b] = CHACHA20_ROTL(x[b], 7)
+
+    for (i = 0; i < 10; i++) {
+        CHACHA20_QR(0, 4, 8, 12);
+        CHACHA20_QR(1, 5, 9, 13);
+        CHACHA20_QR(2, 6, 10, 14);
+        CHACHA20_QR(3, 7, 11, 15);
+        CHACHA20_QR(0, 5, 10, 15);
+        CHACHA20_QR(1, 6, 11, 12);
+        CHACHA20_QR(2, 7, 8, 13);
+        CHACHA20_QR(3, 4, 9, 14);
+    }
+
+#undef CHACHA20_QR
+#undef CHACHA20_ROTL
+
+    for (i = 0; i < 16; i++) {
+        uint32_t v = x[i] + s[i];
+        out[4 * i + 0] = (uint8_t)v;
+        out[4 * i + 1] = (uint8_t)(v >> 8);
+        out[4 * i + 2] = (uint8_t)(v >> 16);
+        out[4 * i + 3] = (uint8_t)(v >> 24);
+    }
+}
+
+/*
+ * Deterministic random bit generator on the ChaCha20 keystream, with
+ * fast key erasure: each refill computes CHACHA20_DRBG_BLOCKS blocks,
+ * takes the first 32 bytes as the next key and hands out the rest, so
+ * the state never reveals output already handed out. fill takes a lock,
+ * so one instance can be shared between threads, as a seeded one
+ * installed by set_random_source is.
+ */
+class ChaCha20Drbg : public RandomSource {
+
+public:
+    /*
+     * Seeded from the operating system, and seeded again in a child
+     * process after fork so that parent and child do not share a stream
+     */
+    ChaCha20Drbg() {
+        seed_from_os();
+    }
+
+    /*
+     * Reproducible output, for tests and benchmarks. A fixed seed is kept
+     * across fork, so a child repeats the parent's stream.
+     */
+    explicit ChaCha20Drbg(const uint8_t seed[32]) {
+        uint32_t key[8];
+        for (int i = 0; i < 8; i++)
+            key[i] = (uint32_t)seed[4 * i] | ((uint32_t)seed[4 * i + 1] << 8) |
+                     ((uint32_t)seed[4 * i + 2] << 16) | ((uint32_t)seed[4 * i + 3] << 24);
+        rekey(key);
+        pid_ = 0;
+    }
+
+    explicit ChaCha20Drbg(uint64_t seed) {
+        uint32_t key[8] = {(uint32_t)seed, (uint32_t)(seed >> 32), 0, 0, 0, 0, 0, 0};
+        rekey(key);
+        pid_ = 0;
+    }
+
+    ~ChaCha20Drbg() {
+        memset(key_, 0, sizeof(key_));
+        memset(buffer_, 0, sizeof(buffer_));
+    }
+
+    void fill(void* data, size_t len) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint8_t* out = (uint8_t*)data;
+
+        // A forked child must not replay the parent's stream
+        if (pid_ != 0 && pid_ != getpid())
+            seed_from_os();
+        while (len > 0) {
+            if (used_ == sizeof(buffer_))
+                refill();
+            size_t n = std::min(len, sizeof(buffer_) - used_);
+            memcpy(out, buffer_ + used_, n);
+            // Handed-out bytes do not stay in memory
+            memset(buffer_ + used_, 0, n);
+            used_ += n;
+            out += n;
+            len -= n;
+        }
+    }
+
+private:
+    void seed_from_os() {
+        uint32_t seed[8];
+        std::random_device rd;
+        for (int i = 0; i < 8; i++)
+            seed[i] = rd();
+        rekey(seed);
+        memset(seed, 0, sizeof(seed));
+        pid_ = getpid();
+    }
+
+    void rekey(const uint32_t key[8]) {
+        memcpy(key_, key, sizeof(key_));
+        used_ = sizeof(buffer_);
+    }
+
+    /* The first 32 bytes of the keystream become the next key */
+    void refill() {
+        static const uint32_t nonce[3] = {0, 0, 0};
+        int i;
+
+        for (i = 0; i < CHACHA20_DRBG_BLOCKS; i++)
+            chacha20_block(buffer_ + 64 * i, key_, (uint32_t)i, nonce);
+        for (i = 0; i < 8; i++)
+            key_[i] = (uint32_t)buffer_[4 * i] | ((uint32_t)buffer_[4 * i + 1] << 8) |
+                      ((uint32_t)buffer_[4 * i + 2] << 16) | ((uint32_t)buffer_[4 * i + 3] << 24);
+        memset(buffer_, 0, 32);
+        used_ = 32;
+    }
+
+    uint32_t key_[8];
+    uint8_t buffer_[64 * CHACHA20_DRBG_BLOCKS];
+    size_t used_;
+    /* Process the OS seed belongs to, 0 for a fixed seed */
+    pid_t pid_;
+    std::mutex mutex_;
+};
+
+/*
+ * Installed through set_random_source, nullptr for the per-thread default.
+ * A function-local static of an inline function, so that the whole
+ * program shares one, whichever translation unit installs a source.
+ */
+inline std::atomic<RandomSource*>& global_random_source() {
+    static std::atomic<RandomSource*> source(nullptr);
+    return source;
+}
+
+/*
+ * Draw from source from now on, or from a per-thread ChaCha20Drbg seeded
+ * from the operating system if source is nullptr (the default). source is
+ * not owned and must outlive its use. It applies to every translation
+ * unit of the program, not only the calling one.
+ */
+inline void set_random_source(RandomSource* source) {
+    global_random_source().store(source, std::memory_order_release);
+}
+
+inline void random_bytes(void* data, size_t len) {
+    RandomSource* source = global_random_source().load(std::memory_order_acquire);
+    if (source != nullptr) {
+        source->fill(data, len);
+        return;
+    }
+    static thread_local ChaCha20Drbg drbg;
+    drbg.fill(data, len);
+}
+
+/*
+ * A uniformly random scalar modulo the group order: 64 random bytes
+ * reduced by x25519_sc_reduce, so the bias is around 2^-260.
+ */
+inline void random_scalar(uint8_t s[32]) {
+    uint8_t wide[64];
+    random_bytes(wide, sizeof(wide));
+    x25519_sc_reduce(wide);
+    memcpy(s, wide, 32);
+    memset(wide, 0, sizeof(wide));
+}
+
+#endif // RANDOM_SOURCE_H
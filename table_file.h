@@ -0,0 +1,135 @@
+/*
+ * Copyright 2019 Zhicong Huang (zhicong303@gmail.com). All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution.
+ */
+
+#ifndef TABLE_FILE_H
+#define TABLE_FILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lookup_table.h"
+
+/*
+ * On-disk layout of a decryption table (all fields little-endian):
+ *
+ *   TableHeader                       64 bytes
+ *   LookupBucket[num_buckets]         64 bytes each
+ *
+ * The bucket array is exactly the in-memory layout of LookupTable, and the
+ * header size keeps it cache-line aligned, so a mapped file can be probed
+ * in place without any parsing.
+ */
+
+/* "LHE25519" in little-endian */
+#define TABLE_MAGIC 0x393135353245484cULL
+#define TABLE_VERSION 1
+
+/* TableHeader.flags: only non-negative giant steps are stored (see DecryptionTable) */
+#define TABLE_FLAG_SYMMETRIC 0x1
+
+struct TableHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t msg_bits;
+    uint32_t baby_bits;
+    uint32_t flags;
+    uint64_t num_entries;
+    uint64_t num_buckets;
+    uint64_t checksum;
+    uint8_t reserved[16];
+};
+
+static_assert(sizeof(TableHeader) == sizeof(LookupBucket),
+              "Table header must keep the bucket array cache-line aligned");
+
+/*
+ * 64-bit checksum of the bucket array (FNV-1a over 64-bit words). It only
+ * guards against truncated or corrupted files, not against tampering.
+ */
+inline uint64_t table_checksum(const LookupBucket* buckets, size_t num_buckets) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(buckets);
+    size_t words = num_buckets * sizeof(LookupBucket) / sizeof(uint64_t);
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < words; i++) {
+        uint64_t w;
+        memcpy(&w, p + i * sizeof(uint64_t), sizeof(uint64_t));
+        h = (h ^ w) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/*
+ * Throws if header is not a valid table header, or if file_size (when
+ * non-zero) does not match it.
+ */
+inline void check_table_header(const TableHeader& header, size_t file_size = 0) {
+    if (header.magic != TABLE_MAGIC)
+        throw std::runtime_error("Not a decryption table file");
+    if (header.version != TABLE_VERSION)
+        throw std::runtime_error("Unsupported decryption table version");
+    if (header.flags & ~TABLE_FLAG_SYMMETRIC)
+        throw std::runtime_error("Unsupported decryption table flags");
+    if (header.num_entries > header.num_buckets * LOOKUP_SLOTS_PER_BUCKET)
+        throw std::runtime_error("Corrupted decryption table header");
+    if (file_size != 0 &&
+        file_size != sizeof(TableHeader) + header.num_buckets * sizeof(LookupBucket))
+        throw std::runtime_error("Decryption table file has the wrong size");
+}
+
+/*
+ * Read-only shared mapping of a whole file. Processes mapping the same file
+ * share one page-cache copy.
+ */
+class MappedFile {
+
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Unable to open " + path);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            throw std::runtime_error("Unable to stat " + path);
+        }
+        size_ = (size_t)st.st_size;
+
+        void* addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("Unable to map " + path);
+        data_ = static_cast<const uint8_t*>(addr);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+
+    const uint8_t* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+};
+
+#endif // TABLE_FILE_H
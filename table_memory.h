@@ -0,0 +1,241 @@
+/*
+ * Copyright 2019 Zhicong Huang (zhicong303@gmail.com). All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution.
+ */
+
+#ifndef TABLE_MEMORY_H
+#define TABLE_MEMORY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/*
+ * Memory for decryption tables. Probes land on random cache lines of a
+ * table of up to several GB, so with 4 KB pages nearly every probe also
+ * misses the TLB, and on multi-socket hosts half of them go to the memory
+ * of the other socket. Tables can instead sit on huge pages, have one
+ * replica per NUMA node, and be faulted in when they are loaded rather
+ * than by the first decryptions.
+ */
+
+/*
+ * Page size backing the tables built or loaded into memory. Explicit huge
+ * pages (MAP_HUGETLB) need pages reserved by the administrator
+ * (vm.nr_hugepages, or hugepagesz=1G at boot); without them, allocation
+ * falls back to 2 MB pages, then to transparent huge pages. Transparent
+ * huge pages (madvise(MADV_HUGEPAGE)) only need THP set to "madvise" or
+ * "always", and also apply to mapped tables when the kernel allows it for
+ * the page cache or shared memory.
+ */
+enum class TablePages {
+    Default,
+    Transparent,
+    Huge2MB,
+    Huge1GB
+};
+
+struct TablePlacement {
+    TablePages pages = TablePages::Default;
+
+    /* One copy of the table per NUMA node, each probed from its own node */
+    bool numa_replicas = false;
+
+    /* Fault every page in when the table is loaded, mapped or built */
+    bool prefault = false;
+};
+
+#define TABLE_PAGE_2MB (1UL << 21)
+#define TABLE_PAGE_1GB (1UL << 30)
+
+#ifndef MAP_HUGE_SHIFT
+# define MAP_HUGE_SHIFT 26
+#endif
+
+#ifndef MADV_POPULATE_READ
+# define MADV_POPULATE_READ 22
+#endif
+
+/* MPOL_BIND and MPOL_MF_MOVE from <numaif.h>, so as not to depend on libnuma */
+#define TABLE_MPOL_BIND 2
+#define TABLE_MPOL_MF_MOVE 2
+
+inline size_t table_round_up(size_t size, size_t unit) {
+    return (size + unit - 1) / unit * unit;
+}
+
+/* Ask for transparent huge pages on an existing mapping */
+inline void table_memory_advise(const void* data, size_t size, TablePages pages) {
+#ifdef MADV_HUGEPAGE
+    if (pages == TablePages::Default || size == 0)
+        return;
+    // madvise wants a page-aligned start
+    uintptr_t start = (uintptr_t)data & ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1);
+    madvise((void*)start, (uintptr_t)data + size - start, MADV_HUGEPAGE);
+#else
+    (void)data;
+    (void)size;
+    (void)pages;
+#endif
+}
+
+/*
+ * Read one byte of every page, after asking the kernel to populate the
+ * range in one go where it can (Linux 5.14 and later).
+ */
+inline void table_memory_prefault(const void* data, size_t size) {
+    if (size == 0)
+        return;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)data & ~(uintptr_t)(page - 1);
+    if (madvise((void*)start, (uintptr_t)data + size - start, MADV_POPULATE_READ) == 0)
+        return;
+
+    const volatile uint8_t* p = static_cast<const volatile uint8_t*>(data);
+    uint8_t sum = 0;
+    for (size_t i = 0; i < size; i += page)
+        sum += p[i];
+    sum += p[size - 1];
+    (void)sum;
+}
+
+/*
+ * Bind the page-aligned range [data, data+size) to NUMA node: pages
+ * touched later come from it, and with move the pages it already has are
+ * migrated to it. Failures (no NUMA support) leave the memory as it is.
+ */
+inline void table_memory_bind(void* data, size_t size, int node, bool move = false) {
+#ifdef SYS_mbind
+    if (node < 0 || node >= 64)
+        return;
+    unsigned long mask = 1UL << node;
+    syscall(SYS_mbind, data, size, TABLE_MPOL_BIND, &mask, sizeof(mask) * 8,
+            move ? TABLE_MPOL_MF_MOVE : 0);
+#else
+    (void)data;
+    (void)size;
+    (void)node;
+    (void)move;
+#endif
+}
+
+/*
+ * Zeroed memory for size bytes on the given pages, bound to NUMA node
+ * (any node if node < 0). *mapped receives the length to pass to
+ * table_memory_free.
+ */
+inline void* table_memory_alloc(size_t size, TablePages pages, int node, size_t* mapped) {
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void* addr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (pages == TablePages::Huge1GB) {
+        *mapped = table_round_up(size, TABLE_PAGE_1GB);
+        addr = mmap(nullptr, *mapped, PROT_READ | PROT_WRITE,
+                    flags | MAP_HUGETLB | (30 << MAP_HUGE_SHIFT), -1, 0);
+    }
+    if (addr == MAP_FAILED && (pages == TablePages::Huge1GB || pages == TablePages::Huge2MB)) {
+        *mapped = table_round_up(size, TABLE_PAGE_2MB);
+        addr = mmap(nullptr, *mapped, PROT_READ | PROT_WRITE,
+                    flags | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+    }
+#endif
+    if (addr == MAP_FAILED && pages != TablePages::Default) {
+        // 2 MB aligned, so that transparent huge pages cover all of it
+        size_t length = table_round_up(size, TABLE_PAGE_2MB);
+        void* raw = mmap(nullptr, length + TABLE_PAGE_2MB, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (raw != MAP_FAILED) {
+            uintptr_t begin = (uintptr_t)raw;
+            uintptr_t aligned = table_round_up(begin, TABLE_PAGE_2MB);
+            if (aligned > begin)
+                munmap(raw, aligned - begin);
+            if (begin + TABLE_PAGE_2MB > aligned)
+                munmap((void*)(aligned + length), begin + TABLE_PAGE_2MB - aligned);
+            addr = (void*)aligned;
+            *mapped = length;
+            table_memory_advise(addr, length, TablePages::Transparent);
+        }
+    }
+    if (addr == MAP_FAILED) {
+        *mapped = table_round_up(size, (size_t)sysconf(_SC_PAGESIZE));
+        addr = mmap(nullptr, *mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+    }
+    if (addr == MAP_FAILED)
+        throw std::bad_alloc();
+
+    table_memory_bind(addr, *mapped, node);
+    return addr;
+}
+
+inline void table_memory_free(void* data, size_t mapped) {
+    if (data != nullptr)
+        munmap(data, mapped);
+}
+
+/* Number of NUMA nodes (the highest online one plus 1), 1 without NUMA */
+inline int numa_node_count() {
+    static const int count = []() {
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string ranges;
+        if (!(online >> ranges))
+            return 1;
+        // e.g. "0", "0-1" or "0,2-3": the last number is the highest node
+        size_t last = ranges.find_last_of(",-");
+        int node = atoi(ranges.c_str() + (last == std::string::npos ? 0 : last + 1));
+        return node + 1;
+    }();
+    return count;
+}
+
+/* NUMA node of each CPU, from /sys/devices/system/node/node<N>/cpulist */
+inline const std::vector<int>& numa_cpu_nodes() {
+    static const std::vector<int> nodes = []() {
+        std::vector<int> cpu_nodes;
+        for (int node = 0; node < numa_node_count(); node++) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!(file >> list))
+                continue;
+            // e.g. "0-15,32-47"
+            for (size_t pos = 0; pos < list.size(); ) {
+                size_t end = list.find(',', pos);
+                if (end == std::string::npos)
+                    end = list.size();
+                int lo = 0, hi = 0;
+                int fields = sscanf(list.c_str() + pos, "%d-%d", &lo, &hi);
+                if (fields == 1)
+                    hi = lo;
+                if (fields >= 1 && hi >= lo) {
+                    if ((int)cpu_nodes.size() <= hi)
+                        cpu_nodes.resize(hi + 1, 0);
+                    for (int cpu = lo; cpu <= hi; cpu++)
+                        cpu_nodes[cpu] = node;
+                }
+                pos = end + 1;
+            }
+        }
+        return cpu_nodes;
+    }();
+    return nodes;
+}
+
+/* NUMA node of the CPU the calling thread runs on right now */
+inline int numa_current_node() {
+    int cpu = sched_getcpu();
+    const std::vector<int>& nodes = numa_cpu_nodes();
+    return cpu >= 0 && cpu < (int)nodes.size() ? nodes[cpu] : 0;
+}
+
+#endif // TABLE_MEMORY_H
@@ -0,0 +1,334 @@
+/*
+ * Copyright 2019 Zhicong Huang (zhicong303@gmail.com). All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution.
+ */
+
+#ifndef TABLE_REGISTRY_H
+#define TABLE_REGISTRY_H
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <fstream>
+#include <istream>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "decryption_table.h"
+#include "table_file.h"
+
+/* Segments are named TABLE_SEGMENT_PREFIX-<msg_bits>-<baby_bits>[-sym] */
+#ifndef TABLE_SEGMENT_PREFIX
+# define TABLE_SEGMENT_PREFIX "/lhe25519-table"
+#endif
+
+/* How long to wait for a segment that another process is filling */
+#define TABLE_SEGMENT_WAIT_MS 60000
+
+/*
+ * Read-only shared mapping of a whole POSIX shared memory segment.
+ */
+class SharedSegment {
+
+public:
+    SharedSegment(int fd, size_t size, const std::string& name)
+        : size_(size) {
+        void* addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("Unable to map shared memory segment " + name);
+        data_ = static_cast<const uint8_t*>(addr);
+    }
+
+    SharedSegment(const SharedSegment&) = delete;
+    SharedSegment& operator=(const SharedSegment&) = delete;
+
+    ~SharedSegment() {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+
+    const uint8_t* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+};
+
+/*
+ * Decryption tables shared by all processes of a host: the table of each
+ * split lives once in a named POSIX shared memory segment (under
+ * /dev/shm on Linux) in the format of table files, and every process maps
+ * the same physical pages read-only and probes them in place.
+ *
+ * The first process asking for a split creates its segment and fills it
+ * from a table file (as written by LHE25519::save_table), holding an
+ * exclusive lock on it meanwhile; the others wait for the lock and attach.
+ * Within a process, the registry hands out the same DecryptionTable for as
+ * long as some instance uses it.
+ *
+ * Segments outlive the processes, as files do, until remove is called.
+ * They are created readable by their owner only, and a process attaches
+ * only segments owned by its effective user; load also checks that the
+ * segment holds the table of its file.
+ *
+ * The placement passed to load and attach applies when this process first
+ * attaches the segment (see DecryptionTable::place); NUMA replicas are
+ * private copies of the process.
+ */
+class TableRegistry {
+
+public:
+    static TableRegistry& instance() {
+        static TableRegistry registry;
+        return registry;
+    }
+
+    static std::string segment_name(int msg_bits, int baby_bits, bool symmetric) {
+        return std::string(TABLE_SEGMENT_PREFIX) + "-" + std::to_string(msg_bits) + "-" +
+               std::to_string(baby_bits) + (symmetric ? "-sym" : "");
+    }
+
+    /*
+     * The table of the split recorded in the file at path, attached from
+     * its segment, which is created from the file first if need be.
+     */
+    std::shared_ptr<const DecryptionTable> load(const std::string& path,
+                                                const TablePlacement& placement = TablePlacement()) {
+        std::ifstream stream(path, std::ifstream::in | std::ifstream::binary);
+        if (!stream)
+            throw std::runtime_error("Unable to open " + path);
+        return load(stream, placement);
+    }
+
+    /*
+     * Same as above with a table file being read from stream. Only its
+     * header is read when the segment already exists. The old record
+     * format has no header, and is not accepted.
+     */
+    std::shared_ptr<const DecryptionTable> load(std::istream& stream,
+                                                const TablePlacement& placement = TablePlacement()) {
+        TableHeader header;
+        stream.read((char*)&header, sizeof(header));
+        if (!stream)
+            throw std::runtime_error("Decryption table file is truncated");
+        DecryptionTable::check_header(header);
+        bool symmetric = header.flags & TABLE_FLAG_SYMMETRIC;
+
+        std::string name = segment_name(header.msg_bits, header.baby_bits, symmetric);
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<const DecryptionTable> table = cached(name, &header);
+        if (table)
+            return table;
+
+        // Attach, or create, unless another process creates it first
+        for (;;) {
+            int fd = shm_open(name.c_str(), O_RDONLY, 0);
+            if (fd >= 0)
+                return attach_fd(fd, name, header.msg_bits, header.baby_bits, symmetric, placement,
+                                 &header);
+            if (errno != ENOENT)
+                throw std::runtime_error("Unable to open shared memory segment " + name);
+            if (create(name, header, stream))
+                return attach_locked(name, header.msg_bits, header.baby_bits, symmetric, placement,
+                                     &header);
+        }
+    }
+
+    /*
+     * The table of a split whose segment some process has already
+     * created, nullptr if there is none.
+     */
+    std::shared_ptr<const DecryptionTable> attach(int msg_bits, int baby_bits, bool symmetric = false,
+                                                  const TablePlacement& placement = TablePlacement()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return attach_locked(segment_name(msg_bits, baby_bits, symmetric), msg_bits, baby_bits,
+                             symmetric, placement);
+    }
+
+    /*
+     * Remove the segment of a split from the host. Processes attached to
+     * it keep their mapping; later loads create a new one.
+     */
+    void remove(int msg_bits, int baby_bits, bool symmetric = false) {
+        std::string name = segment_name(msg_bits, baby_bits, symmetric);
+        std::lock_guard<std::mutex> lock(mutex_);
+        tables_.erase(name);
+        if (shm_unlink(name.c_str()) != 0 && errno != ENOENT)
+            throw std::runtime_error("Unable to remove shared memory segment " + name);
+    }
+
+private:
+    TableRegistry() {}
+
+    /* A table this process still holds, checked against expected if given */
+    std::shared_ptr<const DecryptionTable> cached(const std::string& name,
+                                                  const TableHeader* expected = nullptr) {
+        std::map<std::string, Entry>::iterator it = tables_.find(name);
+        if (it == tables_.end())
+            return nullptr;
+        std::shared_ptr<const DecryptionTable> table = it->second.table.lock();
+        if (table)
+            check_same_table(it->second.header, expected, name);
+        return table;
+    }
+
+    static void check_same_table(const TableHeader& header, const TableHeader* expected,
+                                 const std::string& name) {
+        if (expected && (header.checksum != expected->checksum ||
+                         header.num_buckets != expected->num_buckets ||
+                         header.num_entries != expected->num_entries))
+            throw std::runtime_error("Shared memory segment " + name +
+                                     " does not hold the table of the file");
+    }
+
+    std::shared_ptr<const DecryptionTable> attach_locked(const std::string& name, int msg_bits,
+                                                         int baby_bits, bool symmetric,
+                                                         const TablePlacement& placement,
+                                                         const TableHeader* expected = nullptr) {
+        std::shared_ptr<const DecryptionTable> table = cached(name, expected);
+        if (table)
+            return table;
+
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            if (errno == ENOENT)
+                return nullptr;
+            throw std::runtime_error("Unable to open shared memory segment " + name);
+        }
+        return attach_fd(fd, name, msg_bits, baby_bits, symmetric, placement, expected);
+    }
+
+    /*
+     * Map the segment open on fd once its creator is done with it: the
+     * creator holds an exclusive lock while filling it and writes the
+     * header magic last. Waiting more than once only happens when the
+     * creator has not taken its lock yet, or died before finishing.
+     *
+     * The segment must belong to the effective user, and match the
+     * checksum and sizes of the expected header, if any.
+     */
+    std::shared_ptr<const DecryptionTable> attach_fd(int fd, const std::string& name, int msg_bits,
+                                                     int baby_bits, bool symmetric,
+                                                     const TablePlacement& placement,
+                                                     const TableHeader* expected) {
+        struct stat owner;
+        if (fstat(fd, &owner) != 0 || owner.st_uid != geteuid()) {
+            close(fd);
+            throw std::runtime_error("Shared memory segment " + name +
+                                     " is not owned by this user");
+        }
+
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(TABLE_SEGMENT_WAIT_MS);
+        std::shared_ptr<SharedSegment> segment;
+        while (!segment) {
+            flock(fd, LOCK_SH);
+            struct stat st;
+            if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TableHeader)) {
+                std::shared_ptr<SharedSegment> mapped =
+                    std::make_shared<SharedSegment>(fd, (size_t)st.st_size, name);
+                const TableHeader* header = reinterpret_cast<const TableHeader*>(mapped->data());
+                if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == TABLE_MAGIC)
+                    segment = mapped;
+            }
+            flock(fd, LOCK_UN);
+
+            if (!segment && std::chrono::steady_clock::now() > deadline) {
+                close(fd);
+                throw std::runtime_error("Shared memory segment " + name +
+                                         " was left incomplete, remove it");
+            }
+            if (!segment)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        close(fd);
+
+        const TableHeader* header = reinterpret_cast<const TableHeader*>(segment->data());
+        check_same_table(*header, expected, name);
+
+        std::shared_ptr<DecryptionTable> table = std::make_shared<DecryptionTable>();
+        table->set_placement(placement);
+        table->view_image(segment->data(), segment->size(), segment);
+        if (table->msg_bits() != msg_bits || table->baby_bits() != baby_bits ||
+            table->symmetric() != symmetric)
+            throw std::runtime_error("Shared memory segment " + name + " holds another split");
+        Entry& entry = tables_[name];
+        entry.table = table;
+        entry.header = *header;
+        return table;
+    }
+
+    /*
+     * Create the segment and copy the buckets following header in stream
+     * into it, verifying the checksum. Returns false if the segment exists
+     * already.
+     */
+    bool create(const std::string& name, const TableHeader& header, std::istream& stream) {
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            if (errno == EEXIST)
+                return false;
+            throw std::runtime_error("Unable to create shared memory segment " + name);
+        }
+        flock(fd, LOCK_EX);
+
+        size_t size = sizeof(TableHeader) + header.num_buckets * sizeof(LookupBucket);
+        void* addr = MAP_FAILED;
+        if (ftruncate(fd, (off_t)size) == 0)
+            addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            close(fd);
+            throw std::runtime_error("Unable to allocate shared memory segment " + name);
+        }
+
+        uint8_t* data = static_cast<uint8_t*>(addr);
+        LookupBucket* buckets = reinterpret_cast<LookupBucket*>(data + sizeof(TableHeader));
+        stream.read((char*)buckets, header.num_buckets * sizeof(LookupBucket));
+        if (!stream || table_checksum(buckets, header.num_buckets) != header.checksum) {
+            munmap(addr, size);
+            shm_unlink(name.c_str());
+            close(fd);
+            throw std::runtime_error("Decryption table checksum mismatch");
+        }
+
+        // The magic goes last: attaching processes take the segment as complete then
+        TableHeader* target = reinterpret_cast<TableHeader*>(data);
+        memcpy((uint8_t*)target + sizeof(uint64_t), (const uint8_t*)&header + sizeof(uint64_t),
+               sizeof(TableHeader) - sizeof(uint64_t));
+        __atomic_store_n(&target->magic, header.magic, __ATOMIC_RELEASE);
+
+        munmap(addr, size);
+        flock(fd, LOCK_UN);
+        close(fd);
+        return true;
+    }
+
+    /* A table handed out, and the header of its segment */
+    struct Entry {
+        std::weak_ptr<const DecryptionTable> table;
+        TableHeader header;
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, Entry> tables_;
+};
+
+#endif // TABLE_REGISTRY_H